@@ -0,0 +1,312 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPluginLoader>
+#include <QSemaphore>
+#include <QTemporaryDir>
+#include <QThread>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <functional>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+#include "ai_plugin_manager.h"
+#include "color_index.h"
+#include "frame_pool.h"
+#include "image_convert.h"
+#include "plugins/hsv/hsv_kernel.h"
+#include "tone_map.h"
+
+// Minimal harness: every benchmark is warmed up, then timed per iteration
+// until minTime has elapsed, and summarized as mean/median/min/stddev.
+class BenchmarkRunner
+{
+public:
+    BenchmarkRunner(double minTimeSeconds, const QString& filter) : minTime(minTimeSeconds), filter(filter) {}
+
+    void run(const QString& name, const QString& variant, const std::function<void()>& body)
+    {
+        QString fullName = variant.isEmpty() ? name : name + "/" + variant;
+        if (!filter.isEmpty() && !fullName.contains(filter))
+            return;
+
+        for (int i = 0; i < 2; i++)
+            body();
+
+        std::vector<double> samples;
+        QElapsedTimer total;
+        total.start();
+        while (samples.size() < 5 || (total.nsecsElapsed() < minTime * 1e9 && samples.size() < 10000))
+        {
+            QElapsedTimer timer;
+            timer.start();
+            body();
+            samples.push_back(timer.nsecsElapsed() / 1e6);
+        }
+
+        std::sort(samples.begin(), samples.end());
+        double sum = 0.0;
+        for (double s : samples)
+            sum += s;
+        double mean = sum / samples.size();
+        double var = 0.0;
+        for (double s : samples)
+            var += (s - mean) * (s - mean);
+        double median = samples[samples.size() / 2];
+        double stddev = std::sqrt(var / samples.size());
+
+        std::printf("%-48s %8zu iters  mean %10.3f ms  median %10.3f ms  min %10.3f ms  sd %8.3f\n",
+                    fullName.toUtf8().constData(),
+                    samples.size(),
+                    mean,
+                    median,
+                    samples.front(),
+                    stddev);
+        std::fflush(stdout);
+
+        QJsonObject result;
+        result["name"] = name;
+        result["variant"] = variant;
+        result["iterations"] = static_cast<int>(samples.size());
+        result["mean_ms"] = mean;
+        result["median_ms"] = median;
+        result["min_ms"] = samples.front();
+        result["stddev_ms"] = stddev;
+        results.append(result);
+    }
+
+    QJsonArray takeResults() { return results; }
+
+private:
+    double minTime;
+    QString filter;
+    QJsonArray results;
+};
+
+static cv::Mat syntheticImage(int width, int height)
+{
+    // Smoothed noise with a fixed seed: reproducible, and compresses more like
+    // a photograph than raw noise does.
+    cv::Mat noise(height / 8 + 1, width / 8 + 1, CV_8UC3);
+    cv::RNG rng(42);
+    rng.fill(noise, cv::RNG::UNIFORM, 0, 256);
+    cv::Mat image;
+    cv::resize(noise, image, cv::Size(width, height), 0, 0, cv::INTER_CUBIC);
+    return image;
+}
+
+// Largest per-channel difference between the HSV kernel and cv::cvtColor;
+// hue is circular, so 0 and 179 are one unit apart.
+static int hsvKernelError(const cv::Mat& image)
+{
+    cv::Mat expected, actual;
+    cv::cvtColor(image, expected, cv::COLOR_BGR2HSV);
+    bgrToHsv(image, actual);
+    if (actual.size() != expected.size() || actual.type() != expected.type())
+        return 256;
+    int worst = 0;
+    for (int y = 0; y < image.rows; y++)
+    {
+        const uchar* e = expected.ptr<uchar>(y);
+        const uchar* a = actual.ptr<uchar>(y);
+        for (int x = 0; x < image.cols * 3; x++)
+        {
+            int diff = std::abs(e[x] - a[x]);
+            if (x % 3 == 0)
+                diff = std::min(diff, 180 - diff);
+            worst = std::max(worst, diff);
+        }
+    }
+    return worst;
+}
+
+static QString resolutionName(const cv::Size& size)
+{
+    return QString("%1x%2").arg(size.width).arg(size.height);
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Micro- and macro-benchmarks for the viewer's hot paths.");
+    parser.addHelpOption();
+    QCommandLineOption jsonOption("json", "Write results as JSON to this file.", "path");
+    QCommandLineOption filterOption("filter", "Only run benchmarks whose name contains this string.", "text");
+    QCommandLineOption minTimeOption("min-time", "Minimum measured time per benchmark in seconds.", "seconds", "0.5");
+    QCommandLineOption quickOption("quick", "Only use the smaller resolutions.");
+    QCommandLineOption pluginOption("plugin", "Path to the HSV plugin.", "path", HSV_PLUGIN_PATH);
+    parser.addOptions({jsonOption, filterOption, minTimeOption, quickOption, pluginOption});
+    parser.process(app);
+
+    BenchmarkRunner runner(parser.value(minTimeOption).toDouble(), parser.value(filterOption));
+
+    std::vector<cv::Size> resolutions = {cv::Size(640, 480), cv::Size(1920, 1080)};
+    if (!parser.isSet(quickOption))
+    {
+        resolutions.push_back(cv::Size(4000, 3000));
+        resolutions.push_back(cv::Size(6000, 4000));
+    }
+
+    AIPluginManager manager;
+    QPluginLoader loader(parser.value(pluginOption));
+    AIPlugin* plugin = qobject_cast<AIPlugin*>(loader.instance());
+    if (plugin)
+        manager.addPlugin(plugin);
+    else
+        qWarning() << "HSV plugin not available, skipping plugin benchmarks:" << loader.errorString();
+
+    QTemporaryDir tempDir;
+    int failures = 0;
+    const QStringList extensions = {"png", "jpg", "jpeg", "bmp"};
+
+    for (const cv::Size& size : resolutions)
+    {
+        const cv::Mat image = syntheticImage(size.width, size.height);
+        const QString res = resolutionName(size);
+
+        // A fresh frame-sized buffer, filled so every page is touched, as a
+        // decoder or plugin stage would.
+        runner.run("allocate/std", res, [&]() { cv::Mat m(size, CV_8UC3, cv::Scalar::all(0)); });
+        FramePool::install(256LL * 1024 * 1024);
+        runner.run("allocate/pool", res, [&]() { cv::Mat m(size, CV_8UC3, cv::Scalar::all(0)); });
+        FramePool::install(0);
+
+        cv::Mat gray;
+        cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+        runner.run("cvMatToQImage/bgr", res, [&]() { QImage q = cvMatToQImage(image); });
+        runner.run("cvMatToQImage/gray", res, [&]() { QImage q = cvMatToQImage(gray); });
+
+        // Re-mapping after an exposure change; the mapping itself is computed once.
+        cv::Mat deep16, linear32;
+        image.convertTo(deep16, CV_16UC3, 257.0);
+        image.convertTo(linear32, CV_32FC3, 1.0 / 255.0);
+        DisplayMapping mapping16 = autoDisplayMapping(deep16);
+        DisplayMapping mapping32 = autoDisplayMapping(linear32);
+        mapping16.exposure = mapping32.exposure = 0.5;
+        runner.run("toneMap/16u", res, [&]() { cv::Mat m = toneMap(deep16, mapping16); });
+        runner.run("toneMap/32f", res, [&]() { cv::Mat m = toneMap(linear32, mapping32); });
+        mapping32.curve = DisplayMapping::Reinhard;
+        runner.run("toneMap/32f-reinhard", res, [&]() { cv::Mat m = toneMap(linear32, mapping32); });
+
+        // The kernel promises cvtColor's output to within one unit of rounding.
+        int error = hsvKernelError(image);
+        if (error > 1)
+        {
+            qWarning() << "bgrToHsv differs from cvtColor by" << error << "at" << res;
+            failures++;
+        }
+        cv::Mat hsv;
+        runner.run("bgrToHsv", res, [&]() { bgrToHsv(image, hsv); });
+        runner.run("cvtColor/BGR2HSV", res, [&]() { cv::cvtColor(image, hsv, cv::COLOR_BGR2HSV); });
+
+        for (const QString& ext : extensions)
+        {
+            const std::string path = tempDir.filePath("bench." + ext).toStdString();
+            cv::imwrite(path, image);
+            runner.run("imread/" + ext, res, [&]() { cv::Mat m = cv::imread(path, cv::IMREAD_COLOR); });
+        }
+
+        if (!plugin)
+            continue;
+
+        cv::Mat output;
+        runner.run("HSVPlugin/fetch", res, [&]() { plugin->fetch(image); });
+        runner.run("HSVPlugin/render_result", res, [&]() { plugin->render_result(image, output); });
+
+        cv::Mat buffers[2];
+        const std::vector<int> oneStage = {0};
+        const std::vector<int> threeStages = {0, 0, 0};
+        runner.run("renderChain/1-stage", res, [&]() { cv::Mat m = manager.renderChain(image, oneStage, nullptr, buffers); });
+        runner.run("renderChain/3-stage", res, [&]() { cv::Mat m = manager.renderChain(image, threeStages, nullptr, buffers); });
+        // One plugin instance serializes its branches, so this measures graph
+        // and overlay overhead rather than parallel speedup.
+        const RenderGraph threeBranches = {{0}, {0}, {0}};
+        runner.run("renderGraph/3-branch", res, [&]() { cv::Mat m = manager.renderGraph(image, threeBranches, nullptr); });
+    }
+
+    {
+        // The queries behind the Color Index menu, over random histograms.
+        const int rows = parser.isSet(quickOption) ? 100000 : 1000000;
+        QTemporaryDir indexDir;
+        ColorIndex index;
+        if (index.open(indexDir.path()))
+        {
+            cv::RNG rng(7);
+            ColorIndex::Entry entry;
+            entry.modified = 0;
+            entry.size = 0;
+            cv::Mat histogram(1, ColorIndex::binCount, CV_8U, entry.histogram.data());
+            for (int i = 0; i < rows; i++)
+            {
+                rng.fill(histogram, cv::RNG::UNIFORM, 0, 8);
+                entry.clipped = static_cast<uchar>(rng.uniform(0, 256));
+                index.store(QByteArray::number(i), entry);
+            }
+            const QString variant = QString("%1-rows").arg(rows);
+            runner.run("ColorIndex/distances", variant, [&]() { std::vector<quint16> d = index.distances(entry.histogram); });
+            ColorIndex::Histogram mask = {};
+            std::fill(mask.begin(), mask.begin() + ColorIndex::binCount / 4, 0xff);
+            runner.run("ColorIndex/mass", variant, [&]() { std::vector<quint16> m = index.mass(mask); });
+            index.close();
+            QFile::remove(ColorIndex::indexPath(indexDir.path()));
+        }
+    }
+
+    if (plugin)
+    {
+        // Round trip of a trivial task through the manager: queueing, pool
+        // handoff and signal delivery dominate the plugin work here.
+        QSemaphore finished;
+        QObject::connect(&manager, &AIPluginManager::taskFinished, &manager, [&](int, const cv::Mat3b&) { finished.release(); }, Qt::DirectConnection);
+        QObject::connect(&manager, &AIPluginManager::renderFinished, &manager, [&](quint64, const cv::Mat&) { finished.release(); }, Qt::DirectConnection);
+        const cv::Mat3b tiny(8, 8, cv::Vec3b(0, 0, 0));
+        runner.run("AIPluginManager/startTask", "8x8",
+                   [&]()
+                   {
+                       manager.startTask(0, tiny, 0);
+                       finished.acquire();
+                   });
+        quint64 requestId = 0;
+        runner.run("AIPluginManager/startRender", "8x8",
+                   [&]()
+                   {
+                       manager.startRender(++requestId, tiny, {0});
+                       finished.acquire();
+                   });
+    }
+
+    if (parser.isSet(jsonOption))
+    {
+        QJsonObject root;
+        root["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+        root["opencv_version"] = CV_VERSION;
+        root["qt_version"] = qVersion();
+        root["threads"] = QThread::idealThreadCount();
+        root["benchmarks"] = runner.takeResults();
+        QFile file(parser.value(jsonOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            qWarning() << "Failed to write" << file.fileName();
+            return 1;
+        }
+        file.write(QJsonDocument(root).toJson());
+    }
+    return failures == 0 ? 0 : 2;
+}
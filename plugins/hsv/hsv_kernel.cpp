@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "hsv_kernel.h"
+#include <algorithm>
+#include <opencv2/core/hal/intrin.hpp>
+
+namespace
+{
+    // Scalar reference for the row tails. It performs the same float operations
+    // as the vector path so both produce identical bytes.
+    inline void bgrToHsvPixel(const uchar* src, uchar* dst)
+    {
+        int b = src[0], g = src[1], r = src[2];
+        int v = std::max(b, std::max(g, r));
+        int diff = v - std::min(b, std::min(g, r));
+        int h;
+        if (v == r)
+            h = g - b;
+        else if (v == g)
+            h = b - r + 2 * diff;
+        else
+            h = r - g + 4 * diff;
+        int hi = cvRound(static_cast<float>(h) * (30.f / static_cast<float>(std::max(diff, 1))));
+        int si = cvRound(static_cast<float>(diff) * (255.f / static_cast<float>(std::max(v, 1))));
+        dst[0] = cv::saturate_cast<uchar>(hi < 0 ? hi + 180 : hi);
+        dst[1] = cv::saturate_cast<uchar>(si);
+        dst[2] = static_cast<uchar>(v);
+    }
+
+#if CV_SIMD128
+    // Hue and saturation for four pixels given their 32-bit h numerator, diff and v.
+    inline void hueSat4(const cv::v_int32x4& h, const cv::v_int32x4& diff, const cv::v_int32x4& v, cv::v_int32x4& hOut, cv::v_int32x4& sOut)
+    {
+        using namespace cv;
+        const v_float32x4 one = v_setall_f32(1.f);
+        v_float32x4 hf = v_cvt_f32(h) * (v_setall_f32(30.f) / v_max(v_cvt_f32(diff), one));
+        v_float32x4 sf = v_cvt_f32(diff) * (v_setall_f32(255.f) / v_max(v_cvt_f32(v), one));
+        v_int32x4 hi = v_round(hf);
+        hOut = v_select(hi < v_setzero_s32(), hi + v_setall_s32(180), hi);
+        sOut = v_round(sf);
+    }
+
+    // Hue numerator, diff and value for eight pixels widened to 16 bits.
+    inline void hueSat8(const cv::v_uint16x8& b16, const cv::v_uint16x8& g16, const cv::v_uint16x8& r16, cv::v_int16x8& hOut, cv::v_int16x8& sOut)
+    {
+        using namespace cv;
+        v_int16x8 b = v_reinterpret_as_s16(b16);
+        v_int16x8 g = v_reinterpret_as_s16(g16);
+        v_int16x8 r = v_reinterpret_as_s16(r16);
+        v_int16x8 v = v_max(b, v_max(g, r));
+        v_int16x8 diff = v - v_min(b, v_min(g, r));
+        v_int16x8 diff2 = diff + diff;
+        v_int16x8 h = v_select(v == r, g - b, v_select(v == g, b - r + diff2, r - g + diff2 + diff2));
+
+        v_int32x4 h0, h1, d0, d1, v0, v1, ho0, ho1, so0, so1;
+        v_expand(h, h0, h1);
+        v_expand(diff, d0, d1);
+        v_expand(v, v0, v1);
+        hueSat4(h0, d0, v0, ho0, so0);
+        hueSat4(h1, d1, v1, ho1, so1);
+        hOut = v_pack(ho0, ho1);
+        sOut = v_pack(so0, so1);
+    }
+#endif
+
+    void bgrToHsvRow(const uchar* src, uchar* dst, int width)
+    {
+        int x = 0;
+#if CV_SIMD128
+        using namespace cv;
+        for (; x <= width - 16; x += 16)
+        {
+            v_uint8x16 b, g, r;
+            v_load_deinterleave(src + x * 3, b, g, r);
+            v_uint8x16 v = v_max(b, v_max(g, r));
+
+            v_uint16x8 b0, b1, g0, g1, r0, r1;
+            v_expand(b, b0, b1);
+            v_expand(g, g0, g1);
+            v_expand(r, r0, r1);
+            v_int16x8 h0, h1, s0, s1;
+            hueSat8(b0, g0, r0, h0, s0);
+            hueSat8(b1, g1, r1, h1, s1);
+
+            v_store_interleave(dst + x * 3, v_pack_u(h0, h1), v_pack_u(s0, s1), v);
+        }
+#endif
+        for (; x < width; x++)
+            bgrToHsvPixel(src + x * 3, dst + x * 3);
+    }
+} // namespace
+
+void bgrToHsv(const cv::Mat& src, cv::Mat& dst)
+{
+    if (src.type() != CV_8UC3)
+    {
+        cv::cvtColor(src, dst, cv::COLOR_BGR2HSV);
+        return;
+    }
+    // In-place conversion would need a row buffer; keep the kernel simple.
+    if (dst.data == src.data)
+        dst.release();
+    dst.create(src.size(), CV_8UC3);
+
+    const int width = src.cols;
+    // Stripes of roughly 64K pixels keep the per-task overhead negligible.
+    const double stripes = std::max(1.0, static_cast<double>(src.total()) / (1 << 16));
+    cv::parallel_for_(
+        cv::Range(0, src.rows),
+        [&](const cv::Range& range)
+        {
+            for (int y = range.start; y < range.end; y++)
+                bgrToHsvRow(src.ptr<uchar>(y), dst.ptr<uchar>(y), width);
+        },
+        stripes);
+}
@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef HSV_KERNEL_H
+#define HSV_KERNEL_H
+
+#include <opencv2/opencv.hpp>
+
+// Converts 8-bit BGR to OpenCV's 8-bit HSV encoding (H in [0, 180)) straight
+// into dst, which is only reallocated when its size or type differ. Rows are
+// split across cv::parallel_for_ and each row uses universal intrinsics, so
+// results match cv::cvtColor(COLOR_BGR2HSV) to within one unit of rounding.
+// Inputs other than CV_8UC3 fall back to cv::cvtColor.
+void bgrToHsv(const cv::Mat& src, cv::Mat& dst);
+
+#endif // HSV_KERNEL_H
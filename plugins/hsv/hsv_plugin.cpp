@@ -5,11 +5,17 @@
  */
 
 #include "hsv_plugin.h"
+#include "hsv_kernel.h"
 #include <QtPlugin>
+#include <algorithm>
+#include <cstdlib>
 
-HSVPlugin::HSVPlugin() : currentStatus(AIStatus::Ready)
+HSVPlugin::HSVPlugin() : currentStatus(AIStatus::Ready), logLevel(LogLevel::Info)
 {
-    std::cout << "HSVPlugin created." << std::endl;
+    if (const char* level = std::getenv("HSV_PLUGIN_LOG_LEVEL"))
+        logLevel = static_cast<LogLevel>(std::min(2, std::max(0, std::atoi(level))));
+    if (logEnabled(LogLevel::Info))
+        std::cout << "HSVPlugin created.\n";
 }
 
 HSVPlugin::~HSVPlugin()
@@ -19,62 +25,94 @@ HSVPlugin::~HSVPlugin()
 
 void HSVPlugin::init(const AIConfig& config)
 {
-    std::cout << "HSVPlugin init called." << std::endl;
+    if (logEnabled(LogLevel::Info))
+        std::cout << "HSVPlugin init called.\n";
     currentStatus = AIStatus::Ready;
 }
 
 void HSVPlugin::update_config(const AIConfig& config)
 {
-    std::cout << "HSVPlugin update_config called." << std::endl;
+    if (logEnabled(LogLevel::Info))
+        std::cout << "HSVPlugin update_config called.\n";
 }
 
 void HSVPlugin::deinit()
 {
-    std::cout << "HSVPlugin deinit called." << std::endl;
+    if (logEnabled(LogLevel::Info))
+        std::cout << "HSVPlugin deinit called.\n";
     hsvImage.release();
+    std::atomic_store(&published, AIResultPtr());
     currentStatus = AIStatus::Ready;
 }
 
 void HSVPlugin::fetch(const cv::Mat& image)
 {
-    std::cout << "HSVPlugin fetch called." << std::endl;
+    if (logEnabled(LogLevel::Debug))
+        std::cout << "HSVPlugin fetch called.\n";
     if (image.empty())
     {
         std::cerr << "Input image is empty!" << std::endl;
         currentStatus = AIStatus::Error;
         return;
     }
-    cv::cvtColor(image, hsvImage, cv::COLOR_BGR2HSV);
+    // Never overwrite a published result someone still holds.
+    if (hsvImage.u && hsvImage.u->refcount > 1)
+        hsvImage.release();
+    bgrToHsv(image, hsvImage);
+    AIResultData data;
+    data.image = hsvImage;
+    std::atomic_store(&published, AIResult::publish(getName(), ++sequence, std::move(data)));
     currentStatus = AIStatus::Done;
 }
 
-void* HSVPlugin::get(void* param)
+AIResultPtr HSVPlugin::get_result() const
 {
-    std::cout << "HSVPlugin get called." << std::endl;
-    return static_cast<void*>(&hsvImage);
+    return std::atomic_load(&published);
 }
 
 void HSVPlugin::render_result(const cv::Mat& input, cv::Mat& output)
 {
-    std::cout << "HSVPlugin render_result called." << std::endl;
+    if (logEnabled(LogLevel::Debug))
+        std::cout << "HSVPlugin render_result called.\n";
     if (input.empty())
     {
         std::cerr << "Input image is empty!" << std::endl;
         currentStatus = AIStatus::Error;
         return;
     }
-    cv::cvtColor(input, output, cv::COLOR_BGR2HSV);
+    bgrToHsv(input, output);
     currentStatus = AIStatus::Done;
 }
 
+bool HSVPlugin::render_region(const cv::Mat& input, const cv::Rect& roi, double scale, cv::Mat& output)
+{
+    if (logEnabled(LogLevel::Debug))
+        std::cout << "HSVPlugin render_region called.\n";
+    cv::Rect rect = roi & cv::Rect(0, 0, input.cols, input.rows);
+    if (rect.empty())
+        return false;
+    // Per-pixel conversion, so downscaling first only costs preview accuracy.
+    cv::Mat region = input(rect);
+    if (scale > 0.0 && scale < 1.0)
+    {
+        cv::Mat scaled;
+        cv::resize(region, scaled, cv::Size(std::max(1, cvRound(rect.width * scale)), std::max(1, cvRound(rect.height * scale))), 0, 0, cv::INTER_AREA);
+        region = scaled;
+    }
+    bgrToHsv(region, output);
+    return !output.empty();
+}
+
 void HSVPlugin::cleanup()
 {
-    std::cout << "HSVPlugin cleanup called." << std::endl;
+    if (logEnabled(LogLevel::Info))
+        std::cout << "HSVPlugin cleanup called.\n";
     hsvImage.release();
 }
 
 void HSVPlugin::status(AIStatus status, const std::string& msg)
 {
-    std::cout << "HSVPlugin status update: " << msg << std::endl;
+    if (logEnabled(LogLevel::Info))
+        std::cout << "HSVPlugin status update: " << msg << '\n';
     currentStatus = status;
 }
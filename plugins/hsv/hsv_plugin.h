@@ -17,7 +17,7 @@ class HSVPlugin : public QObject, public AIPlugin
 {
     Q_OBJECT
     Q_INTERFACES(AIPlugin)
-    Q_PLUGIN_METADATA(IID "com.example.AIPluginInterface")
+    Q_PLUGIN_METADATA(IID "com.example.AIPluginInterface/2" FILE "hsv_plugin.json")
 public:
     HSVPlugin();
     virtual ~HSVPlugin();
@@ -26,15 +26,29 @@ public:
     void update_config(const AIConfig& config) override;
     void deinit() override;
     void fetch(const cv::Mat& image) override;
-    void* get(void* param) override;
+    AIResultPtr get_result() const override;
     void render_result(const cv::Mat& input, cv::Mat& output) override;
+    bool render_region(const cv::Mat& input, const cv::Rect& roi, double scale, cv::Mat& output) override;
     void cleanup() override;
     void status(AIStatus status, const std::string& msg) override;
     std::string getName() const override { return "HSV Plugin"; }
 
 private:
+    // Per-frame calls log at Debug; HSV_PLUGIN_LOG_LEVEL=0..2 selects the level.
+    enum class LogLevel
+    {
+        Error = 0,
+        Info,
+        Debug
+    };
+    bool logEnabled(LogLevel level) const { return level <= logLevel; }
+
     cv::Mat hsvImage;
+    // Shares hsvImage's buffer; fetch detaches hsvImage before writing again.
+    AIResultPtr published;
+    uint64_t sequence = 0;
     AIStatus currentStatus;
+    LogLevel logLevel;
 };
 
 #endif // HSV_PLUGIN_H
@@ -9,6 +9,9 @@
 
 #include <QObject>
 
+#include "ai_result.h"
+#include <atomic>
+#include <chrono>
 #include <opencv2/opencv.hpp>
 #include <string>
 
@@ -28,6 +31,25 @@ struct AIConfig
     int param2;
 };
 
+// Shared between the manager and a running plugin call. Plugins doing long
+// work should poll isCanceled() and return early once it turns true.
+class AICancelToken
+{
+public:
+    explicit AICancelToken(int timeoutMs = 0)
+        : canceled(false), hasDeadline(timeoutMs > 0), deadline(std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs))
+    {
+    }
+    void cancel() { canceled.store(true, std::memory_order_relaxed); }
+    bool isCanceled() const { return canceled.load(std::memory_order_relaxed) || isExpired(); }
+    bool isExpired() const { return hasDeadline && std::chrono::steady_clock::now() >= deadline; }
+
+private:
+    std::atomic<bool> canceled;
+    bool hasDeadline;
+    std::chrono::steady_clock::time_point deadline;
+};
+
 class AIPlugin
 {
 public:
@@ -35,15 +57,45 @@ public:
     virtual void init(const AIConfig& config) = 0;
     virtual void update_config(const AIConfig& config) = 0;
     virtual void deinit() = 0;
+    // Inputs are only valid for the duration of the call and may be recycled
+    // buffers (frame pool, shared-memory slots), so plugins must not keep them
+    // or treat an unchanged data pointer as unchanged content. render_result
+    // writes into output; it must not alias plugin-owned storage.
     virtual void fetch(const cv::Mat& image) = 0;
-    virtual void* get(void* param) = 0;
+    // Legacy: a raw pointer into plugin-owned storage, unsafe across threads.
+    // Use get_result instead.
+    virtual void* get(void* param)
+    {
+        (void)param;
+        return nullptr;
+    }
     virtual void render_result(const cv::Mat& input, cv::Mat& output) = 0;
     virtual void cleanup() = 0;
     virtual void status(AIStatus status, const std::string& msg) = 0;
     virtual std::string getName() const = 0;
+    // Part of the result cache key; bump it when the plugin's output changes.
+    virtual std::string getVersion() const { return "1"; }
+    // Set by the manager around fetch/render_result calls made on its workers;
+    // nullptr outside of a managed call.
+    virtual void set_cancel_token(const AICancelToken* token) { (void)token; }
+    // Latest result published by fetch, or nullptr. Safe to call from any thread.
+    virtual AIResultPtr get_result() const { return nullptr; }
+    // Optional fast path for previews: render only roi of input, resized by
+    // scale (<= 1), into output. Return false when the output depends on pixels
+    // outside roi or on full resolution; callers then use render_result.
+    virtual bool render_region(const cv::Mat& input, const cv::Rect& roi, double scale, cv::Mat& output)
+    {
+        (void)input;
+        (void)roi;
+        (void)scale;
+        (void)output;
+        return false;
+    }
 };
 
-#define AI_PLUGIN_IID "com.example.AIPluginInterface"
+// Bump the suffix whenever the vtable above changes, so plugins built against
+// an older header are rejected at load time instead of crashing on a new slot.
+#define AI_PLUGIN_IID "com.example.AIPluginInterface/2"
 Q_DECLARE_INTERFACE(AIPlugin, AI_PLUGIN_IID)
 
 #endif // AI_PLUGIN_INTERFACE_H
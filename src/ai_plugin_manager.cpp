@@ -5,21 +5,39 @@
  */
 
 #include "ai_plugin_manager.h"
+#include "trace.h"
+#include <QCoreApplication>
 #include <QDebug>
+#include <QFileInfo>
+#include <QJsonObject>
+#include <QPluginLoader>
 #include <QThread>
 #include <QtConcurrent>
 
-AIPluginManager::AIPluginManager(QObject* parent) : QObject(parent)
+#ifdef Q_OS_UNIX
+#include "remote_plugin.h"
+#endif
+
+AIPluginManager::AIPluginManager(QObject* parent) : QObject(parent), intermediates(128LL * 1024 * 1024), renderPending(false), maxQueuedTasks(8)
 {
+    qRegisterMetaType<cv::Mat>("cv::Mat");
+    qRegisterMetaType<cv::Mat3b>("cv::Mat3b");
+    qRegisterMetaType<AIResultPtr>("AIResultPtr");
+    pool.setMaxThreadCount(QThread::idealThreadCount());
 }
 
 AIPluginManager::~AIPluginManager()
 {
     cancelAll();
-    for (auto plugin : plugins)
+    cancelRender();
+    pool.waitForDone();
+    for (size_t i = 0; i < plugins.size(); i++)
     {
-        plugin->deinit();
-        delete plugin;
+        if (!plugins[i])
+            continue;
+        if (pluginInfo[i].initialized)
+            plugins[i]->deinit();
+        delete plugins[i];
     }
     plugins.clear();
 }
@@ -27,116 +45,768 @@ AIPluginManager::~AIPluginManager()
 void AIPluginManager::loadModels(const QString& configPath)
 {
     qDebug() << "Loading models from" << configPath;
-    for (auto plugin : plugins)
+    cancelAll();
+    cancelRender();
+    pool.waitForDone();
+    QMutexLocker locker(&mutex);
+    for (size_t i = 0; i < plugins.size(); i++)
     {
-        plugin->deinit();
-        delete plugin;
+        if (!plugins[i])
+            continue;
+        if (pluginInfo[i].initialized)
+            plugins[i]->deinit();
+        delete plugins[i];
     }
     plugins.clear();
+    pluginInfo.clear();
+    latestResults.clear();
+    pluginLocks.clear();
+    traceNames.clear();
+    configs.clear();
+    queues.clear();
 }
 
-void AIPluginManager::startTask(int modelIndex, const cv::Mat3b& image, int timeoutSeconds)
+void AIPluginManager::startTask(int modelIndex, const cv::Mat3b& image, int timeoutSeconds, const QByteArray& sourceKey)
 {
-    QMutexLocker locker(&mutex);
-    if (isTaskRunning())
+    std::vector<Task> dropped;
+    QByteArray key = cacheKey(sourceKey, {modelIndex});
     {
-        qDebug() << "A task is already running. Ignoring new task.";
-        return;
+        QMutexLocker locker(&mutex);
+        if (modelIndex < 0 || modelIndex >= static_cast<int>(plugins.size()))
+        {
+            qDebug() << "Invalid model index";
+            return;
+        }
+
+        Task task;
+        task.modelIndex = modelIndex;
+        task.image = image;
+        task.timeoutSeconds = timeoutSeconds;
+        task.cacheKey = key;
+
+        PluginQueue& queue = queues[modelIndex];
+        queue.pending.push_back(task);
+        while (static_cast<int>(queue.pending.size()) > maxQueuedTasks)
+        {
+            dropped.push_back(queue.pending.front());
+            queue.pending.pop_front();
+        }
+        dispatch(modelIndex);
+    }
+
+    for (const auto& t : dropped)
+    {
+        qDebug() << "Queue for model" << t.modelIndex << "is full. Dropping oldest task.";
+        emit taskFinished(t.modelIndex, cv::Mat3b());
+    }
+}
+
+void AIPluginManager::cancelTask(int modelIndex)
+{
+    std::deque<Task> canceled;
+    {
+        QMutexLocker locker(&mutex);
+        if (modelIndex < 0 || modelIndex >= static_cast<int>(queues.size()))
+            return;
+        PluginQueue& queue = queues[modelIndex];
+        canceled.swap(queue.pending);
+        if (queue.active)
+        {
+            queue.active->cancel();
+            qDebug() << "Task" << modelIndex << "canceled.";
+        }
+    }
+
+    // The running task reports taskFinished itself once the plugin returns.
+    for (const auto& t : canceled)
+        emit taskFinished(t.modelIndex, cv::Mat3b());
+}
+
+void AIPluginManager::cancelAll()
+{
+    int count;
+    {
+        QMutexLocker locker(&mutex);
+        count = static_cast<int>(queues.size());
     }
-    if (modelIndex < 0 || modelIndex >= static_cast<int>(plugins.size()))
+    for (int i = 0; i < count; i++)
+        cancelTask(i);
+}
+
+bool AIPluginManager::isTaskRunning() const
+{
+    QMutexLocker locker(&mutex);
+    for (const auto& q : queues)
     {
-        qDebug() << "Invalid model index";
+        if (q.active || !q.pending.empty())
+            return true;
+    }
+    return false;
+}
+
+bool AIPluginManager::isTaskRunning(int modelIndex) const
+{
+    QMutexLocker locker(&mutex);
+    if (modelIndex < 0 || modelIndex >= static_cast<int>(queues.size()))
+        return false;
+    const PluginQueue& queue = queues[modelIndex];
+    return queue.active || !queue.pending.empty();
+}
+
+void AIPluginManager::dispatch(int modelIndex)
+{
+    PluginQueue& queue = queues[modelIndex];
+    if (queue.active || queue.pending.empty())
         return;
+    Task task = queue.pending.front();
+    queue.pending.pop_front();
+    // The timeout starts when the task leaves the queue, not when it was submitted.
+    task.token = std::make_shared<AICancelToken>(task.timeoutSeconds * 1000);
+    queue.active = task.token;
+    QtConcurrent::run(&pool, [this, task]() { runTask(task); });
+}
+
+void AIPluginManager::runTask(const Task& task)
+{
+    QMutex* pluginLock;
+    {
+        QMutexLocker locker(&mutex);
+        pluginLock = pluginLocks[task.modelIndex].get();
     }
 
-    Task task;
-    task.modelIndex = modelIndex;
-    task.running = true;
-    task.watcher = new QFutureWatcher<void>(this);
-    connect(task.watcher,
-            &QFutureWatcher<void>::finished,
-            [this, modelIndex, taskWatcher = task.watcher]()
+    TRACE_SCOPE("task");
+    qDebug() << "Running AI task for model" << task.modelIndex;
+    emit taskStarted(task.modelIndex);
+
+    cv::Mat result;
+    AIResultPtr published;
+    AIStatus status = AIStatus::Done;
+    QString msg = "Task completed";
+    if (!task.cacheKey.isEmpty())
+        result = results.lookup(task.cacheKey);
+    if (result.empty())
+    {
+        QMutexLocker pluginLocker(pluginLock);
+        AIPlugin* plugin = acquirePlugin(task.modelIndex);
+        if (!plugin)
+        {
+            status = AIStatus::Error;
+            msg = "Plugin failed to load";
+        }
+        else
+        {
+            plugin->set_cancel_token(task.token.get());
+            try
             {
-                QMutexLocker locker(&mutex);
-                cv::Mat3b result;
-                emit taskFinished(modelIndex, result);
-                for (auto& t : tasks)
+                if (!task.token->isCanceled())
                 {
-                    if (t.modelIndex == modelIndex && t.watcher == taskWatcher)
-                    {
-                        t.running = false;
-                        break;
-                    }
+                    plugin->fetch(task.image);
+                    published = plugin->get_result();
                 }
-                taskWatcher->deleteLater();
-            });
+                if (!task.token->isCanceled())
+                    plugin->render_result(task.image, result);
+            }
+            catch (const std::exception& e)
+            {
+                status = AIStatus::Error;
+                msg = QString("Task failed: %1").arg(e.what());
+            }
+            plugin->set_cancel_token(nullptr);
+        }
+    }
+
+    if (status == AIStatus::Done && task.token->isExpired())
+    {
+        status = AIStatus::Timeout;
+        msg = "Task timed out";
+    }
+    else if (status == AIStatus::Done && task.token->isCanceled())
+    {
+        status = AIStatus::Ready;
+        msg = "Task canceled";
+    }
+
+    cv::Mat3b output;
+    if (status == AIStatus::Done && result.type() == CV_8UC3)
+    {
+        output = result;
+        if (!task.cacheKey.isEmpty())
+            results.store(task.cacheKey, result);
+    }
+
+    emit taskStatusChanged(task.modelIndex, static_cast<int>(status), msg);
+    if (published && status == AIStatus::Done)
+    {
+        QMutexLocker locker(&mutex);
+        if (task.modelIndex < static_cast<int>(latestResults.size()))
+            latestResults[task.modelIndex] = published;
+        locker.unlock();
+        emit resultPublished(task.modelIndex, published);
+    }
+    emit taskFinished(task.modelIndex, output);
+    qDebug() << "AI task for model" << task.modelIndex << "finished:" << msg;
 
-    QFuture<void> future = QtConcurrent::run([=]() { runTask(modelIndex, image, timeoutSeconds); });
-    task.future = future;
-    task.watcher->setFuture(task.future);
-    tasks.push_back(task);
-    emit taskStarted(modelIndex);
+    QMutexLocker locker(&mutex);
+    if (task.modelIndex < static_cast<int>(queues.size()))
+    {
+        queues[task.modelIndex].active.reset();
+        dispatch(task.modelIndex);
+    }
 }
 
-void AIPluginManager::cancelTask(int modelIndex)
+bool AIPluginManager::callPlugin(int modelIndex, const AICancelToken* token, const char* what, const std::function<bool(AIPlugin*)>& call)
+{
+    QMutex* pluginLock;
+    const char* traceName;
+    {
+        QMutexLocker locker(&mutex);
+        if (modelIndex < 0 || modelIndex >= static_cast<int>(plugins.size()))
+            return false;
+        pluginLock = pluginLocks[modelIndex].get();
+        traceName = traceNames[modelIndex].constData();
+    }
+
+    QMutexLocker pluginLocker(pluginLock);
+    AIPlugin* plugin = acquirePlugin(modelIndex);
+    if (!plugin)
+        return false;
+    TRACE_SCOPE(traceName);
+    plugin->set_cancel_token(token);
+    bool ok = false;
+    try
+    {
+        ok = call(plugin);
+    }
+    catch (const std::exception& e)
+    {
+        qWarning() << what << "failed for model" << modelIndex << ":" << e.what();
+    }
+    plugin->set_cancel_token(nullptr);
+    return ok && !(token && token->isCanceled());
+}
+
+bool AIPluginManager::renderResult(int modelIndex, const cv::Mat& input, cv::Mat& output, const AICancelToken* token)
+{
+    return callPlugin(modelIndex,
+                      token,
+                      "render_result",
+                      [&](AIPlugin* plugin)
+                      {
+                          plugin->render_result(input, output);
+                          return !output.empty();
+                      });
+}
+
+bool AIPluginManager::renderRegion(int modelIndex, const cv::Mat& input, const cv::Rect& roi, double scale, cv::Mat& output, const AICancelToken* token)
+{
+    return callPlugin(modelIndex, token, "render_region", [&](AIPlugin* plugin) { return plugin->render_region(input, roi, scale, output) && !output.empty(); });
+}
+
+void AIPluginManager::startRender(quint64 requestId, const cv::Mat& image, const std::vector<int>& modelIndices, const QByteArray& sourceKey, const cv::Rect& previewRoi, double previewScale)
 {
+    QByteArray key = cacheKey(sourceKey, modelIndices);
+    QList<QByteArray> keys = stageKeys(sourceKey, modelIndices);
     QMutexLocker locker(&mutex);
-    for (auto& t : tasks)
+    pendingRender.requestId = requestId;
+    pendingRender.image = image;
+    pendingRender.modelIndices = modelIndices;
+    pendingRender.cacheKey = key;
+    pendingRender.stageKeys = keys;
+    pendingRender.graph.clear();
+    pendingRender.branchKeys.clear();
+    pendingRender.previewRoi = previewRoi;
+    pendingRender.previewScale = previewScale;
+    renderPending = true;
+    if (activeRender)
+        activeRender->cancel();
+    else
+        dispatchRender();
+}
+
+void AIPluginManager::startRenderGraph(quint64 requestId, const cv::Mat& image, const RenderGraph& graph, const QByteArray& sourceKey)
+{
+    // The graph's key combines the final key of every branch, in order.
+    std::vector<QList<QByteArray>> branchKeys;
+    QList<QByteArray> graphStages;
+    graphStages << "graph";
+    for (const std::vector<int>& branch : graph)
     {
-        if (t.modelIndex == modelIndex && t.running)
+        branchKeys.push_back(stageKeys(sourceKey, branch));
+        graphStages << (branchKeys.back().isEmpty() ? QByteArray() : branchKeys.back().last());
+    }
+    QByteArray key = sourceKey.isEmpty() ? QByteArray() : ResultCache::makeKey(sourceKey, graphStages);
+    QMutexLocker locker(&mutex);
+    pendingRender.requestId = requestId;
+    pendingRender.image = image;
+    pendingRender.modelIndices.clear();
+    pendingRender.cacheKey = key;
+    pendingRender.stageKeys.clear();
+    pendingRender.graph = graph;
+    pendingRender.branchKeys = branchKeys;
+    pendingRender.previewRoi = cv::Rect();
+    pendingRender.previewScale = 1.0;
+    renderPending = true;
+    if (activeRender)
+        activeRender->cancel();
+    else
+        dispatchRender();
+}
+
+void AIPluginManager::cancelRender()
+{
+    QMutexLocker locker(&mutex);
+    renderPending = false;
+    pendingRender.image.release();
+    if (activeRender)
+        activeRender->cancel();
+}
+
+void AIPluginManager::dispatchRender()
+{
+    if (activeRender || !renderPending)
+        return;
+    RenderRequest request = pendingRender;
+    pendingRender.image.release();
+    renderPending = false;
+    activeRender = std::make_shared<AICancelToken>();
+    std::shared_ptr<AICancelToken> token = activeRender;
+    QtConcurrent::run(&pool, [this, request, token]() { runRender(request, token); });
+}
+
+void AIPluginManager::runRender(const RenderRequest& request, const std::shared_ptr<AICancelToken>& token)
+{
+    TRACE_SCOPE("render_chain");
+    cv::Mat result;
+    if (!request.cacheKey.isEmpty())
+        result = results.lookup(request.cacheKey);
+    if (result.empty() && !request.previewRoi.empty())
+    {
+        cv::Mat preview = renderRegionChain(request.image, request.modelIndices, request.previewRoi, request.previewScale, token.get());
+        if (!preview.empty() && !token->isCanceled())
         {
-            t.running = false;
-            qDebug() << "Task" << modelIndex << "canceled.";
-            cv::Mat3b result;
-            emit taskFinished(modelIndex, result);
+            const cv::Rect& roi = request.previewRoi;
+            emit regionRendered(request.requestId, preview, QRect(roi.x, roi.y, roi.width, roi.height));
+        }
+    }
+    if (result.empty())
+    {
+        // renderBuffers are only touched here, and at most one render runs at a time.
+        if (!request.graph.empty())
+            result = runGraph(request.image, request.graph, request.branchKeys, token.get());
+        else if (request.stageKeys.isEmpty())
+            result = renderChain(request.image, request.modelIndices, token.get(), renderBuffers);
+        else
+            result = renderIncremental(request.image, request.modelIndices, request.stageKeys, token.get());
+        if (!request.cacheKey.isEmpty() && !result.empty() && !token->isCanceled())
+            results.store(request.cacheKey, result);
+    }
+    if (!token->isCanceled())
+        emit renderFinished(request.requestId, result);
+
+    QMutexLocker locker(&mutex);
+    activeRender.reset();
+    dispatchRender();
+}
+
+cv::Mat AIPluginManager::renderChain(const cv::Mat& image, const std::vector<int>& modelIndices, const AICancelToken* token, cv::Mat buffers[2])
+{
+    cv::Mat current = image;
+    int next = 0;
+    for (int modelIndex : modelIndices)
+    {
+        if (token && token->isCanceled())
+            return cv::Mat();
+        cv::Mat& output = buffers[next];
+        if (output.u && output.u->refcount > 1)
+            output.release();
+        // A skipped stage would pass off a partially processed frame as the
+        // chain's result, and callers cache or write whatever is returned.
+        if (!renderResult(modelIndex, current, output, token))
+            return cv::Mat();
+        current = output;
+        next ^= 1;
+    }
+    if (token && token->isCanceled())
+        return cv::Mat();
+    return current;
+}
+
+cv::Mat AIPluginManager::renderIncremental(const cv::Mat& image, const std::vector<int>& modelIndices, const QList<QByteArray>& keys, const AICancelToken* token)
+{
+    // Resume after the longest prefix of the chain whose output is retained,
+    // so changing stage k only reruns stages k and later.
+    cv::Mat current = image;
+    int first = 0;
+    for (int i = keys.size() - 1; i >= 0; i--)
+    {
+        cv::Mat cached = intermediates.lookup(keys[i]);
+        if (!cached.empty())
+        {
+            current = cached;
+            first = i + 1;
+            break;
         }
     }
+    for (int i = first; i < static_cast<int>(modelIndices.size()); i++)
+    {
+        if (token && token->isCanceled())
+            return cv::Mat();
+        // A fresh buffer per stage, since retained outputs must not be
+        // overwritten; the frame pool keeps this from reaching the heap.
+        cv::Mat output;
+        // Only successful stages are retained; a failed one must not be
+        // remembered as having passed its input through.
+        if (!renderResult(modelIndices[i], current, output, token) || (token && token->isCanceled()))
+            return cv::Mat();
+        current = output;
+        if (i < keys.size())
+            intermediates.store(keys[i], current);
+    }
+    return current;
 }
 
-void AIPluginManager::cancelAll()
+cv::Mat AIPluginManager::renderGraph(const cv::Mat& image, const RenderGraph& graph, const AICancelToken* token)
 {
-    QMutexLocker locker(&mutex);
-    for (auto& t : tasks)
+    return runGraph(image, graph, std::vector<QList<QByteArray>>(), token);
+}
+
+cv::Mat AIPluginManager::runGraph(const cv::Mat& image, const RenderGraph& graph, const std::vector<QList<QByteArray>>& branchKeys, const AICancelToken* token)
+{
+    TRACE_SCOPE("render_graph");
+    if (graph.empty())
+        return image;
+    std::vector<cv::Mat> outputs(graph.size());
+    auto runBranch = [&](size_t b)
+    {
+        const QList<QByteArray> keys = b < branchKeys.size() ? branchKeys[b] : QList<QByteArray>();
+        outputs[b] = renderIncremental(image, graph[b], keys, token);
+    };
+    // The first branch runs on this thread. Waiting on a branch the pool has
+    // not started yet runs it here as well, so a busy pool cannot deadlock.
+    std::vector<QFuture<void>> branches;
+    for (size_t b = 1; b < graph.size(); b++)
+        branches.push_back(QtConcurrent::run(&pool, runBranch, b));
+    runBranch(0);
+    for (QFuture<void>& branch : branches)
+        branch.waitForFinished();
+    if (token && token->isCanceled())
+        return cv::Mat();
+    // Compositing the branches that did succeed would be cached as the full result.
+    for (const cv::Mat& output : outputs)
+    {
+        if (output.empty())
+            return cv::Mat();
+    }
+    return overlay(image, outputs);
+}
+
+cv::Mat AIPluginManager::overlay(const cv::Mat& base, const std::vector<cv::Mat>& layers)
+{
+    TRACE_SCOPE("overlay");
+    cv::Mat result;
+    int used = 0;
+    for (const cv::Mat& output : layers)
     {
-        if (t.running)
+        if (output.empty())
+            continue;
+        cv::Mat layer = output;
+        if (layer.size() != base.size())
+            cv::resize(layer, layer, base.size(), 0, 0, cv::INTER_LINEAR);
+        if (layer.channels() != base.channels())
         {
-            t.running = false;
-            qDebug() << "Canceling task" << t.modelIndex;
-            cv::Mat3b result;
-            emit taskFinished(t.modelIndex, result);
+            if (layer.channels() == 1 && base.channels() == 3)
+                cv::cvtColor(layer, layer, cv::COLOR_GRAY2BGR);
+            else if (layer.channels() == 4 && base.channels() == 3)
+                cv::cvtColor(layer, layer, cv::COLOR_BGRA2BGR);
         }
+        if (layer.type() != base.type() && layer.channels() == base.channels())
+            layer.convertTo(layer, base.type());
+        if (layer.type() != base.type())
+        {
+            qWarning() << "Cannot overlay a branch output of type" << output.type() << "onto type" << base.type();
+            continue;
+        }
+        if (++used == 1)
+        {
+            // Copying over a copy of base would only reproduce the layer.
+            result = layer;
+            continue;
+        }
+        cv::Mat diff;
+        cv::absdiff(layer, base, diff);
+        cv::Mat mask;
+        cv::reduce(diff.reshape(1, static_cast<int>(diff.total())), mask, 1, cv::REDUCE_MAX);
+        mask = mask.reshape(1, base.rows) > 0;
+        // The first layer may be a retained intermediate; never write into it.
+        if (used == 2)
+            result = result.clone();
+        layer.copyTo(result, mask);
     }
-    tasks.clear();
+    return result.empty() ? base : result;
 }
 
-bool AIPluginManager::isTaskRunning() const
+cv::Mat AIPluginManager::renderRegionChain(const cv::Mat& image, const std::vector<int>& modelIndices, const cv::Rect& roi, double scale, const AICancelToken* token)
 {
-    for (const auto& t : tasks)
+    TRACE_SCOPE("render_region");
+    cv::Mat current = image;
+    cv::Rect currentRoi = roi & cv::Rect(0, 0, image.cols, image.rows);
+    double currentScale = scale;
+    for (int modelIndex : modelIndices)
     {
-        if (t.running)
-            return true;
+        cv::Mat output;
+        if (!renderRegion(modelIndex, current, currentRoi, currentScale, output, token))
+            return cv::Mat();
+        current = output;
+        currentRoi = cv::Rect(0, 0, current.cols, current.rows);
+        currentScale = 1.0;
     }
-    return false;
+    return current;
+}
+
+AIResultPtr AIPluginManager::latestResult(int modelIndex) const
+{
+    QMutexLocker locker(&mutex);
+    if (modelIndex < 0 || modelIndex >= static_cast<int>(latestResults.size()))
+        return nullptr;
+    return latestResults[modelIndex];
+}
+
+QByteArray AIPluginManager::cacheKey(const QByteArray& sourceKey, const std::vector<int>& modelIndices) const
+{
+    if (sourceKey.isEmpty())
+        return QByteArray();
+    QList<QByteArray> stages;
+    QMutexLocker locker(&mutex);
+    for (int modelIndex : modelIndices)
+    {
+        if (modelIndex < 0 || modelIndex >= static_cast<int>(plugins.size()))
+            return QByteArray();
+        stages << stageIdentity(modelIndex);
+    }
+    return ResultCache::makeKey(sourceKey, stages);
+}
+
+QList<QByteArray> AIPluginManager::stageKeys(const QByteArray& sourceKey, const std::vector<int>& modelIndices) const
+{
+    QList<QByteArray> keys;
+    if (sourceKey.isEmpty())
+        return keys;
+    QList<QByteArray> stages;
+    QMutexLocker locker(&mutex);
+    for (int modelIndex : modelIndices)
+    {
+        if (modelIndex < 0 || modelIndex >= static_cast<int>(plugins.size()))
+            return QList<QByteArray>();
+        stages << stageIdentity(modelIndex);
+        keys << ResultCache::makeKey(sourceKey, stages);
+    }
+    return keys;
+}
+
+QByteArray AIPluginManager::stageIdentity(int modelIndex) const
+{
+    const AIConfig& config = configs[modelIndex];
+    const PluginInfo& info = pluginInfo[modelIndex];
+    return QByteArray::fromStdString(info.name + "|" + info.version + "|" + config.param1) + "|" + QByteArray::number(config.param2);
+}
+
+void AIPluginManager::updateConfig(int modelIndex, const AIConfig& config)
+{
+    QMutex* pluginLock;
+    {
+        QMutexLocker locker(&mutex);
+        if (modelIndex < 0 || modelIndex >= static_cast<int>(plugins.size()))
+            return;
+        pluginLock = pluginLocks[modelIndex].get();
+        configs[modelIndex] = config;
+    }
+    QMutexLocker pluginLocker(pluginLock);
+    AIPlugin* plugin;
+    {
+        QMutexLocker locker(&mutex);
+        // An uninitialized plugin picks the new config up in init.
+        if (!pluginInfo[modelIndex].initialized)
+            return;
+        plugin = plugins[modelIndex];
+    }
+    plugin->update_config(config);
+}
+
+void AIPluginManager::setMaxThreadCount(int count)
+{
+    pool.setMaxThreadCount(qMax(1, count));
 }
 
-void AIPluginManager::runTask(int modelIndex, cv::Mat3b image, int timeoutSeconds)
+int AIPluginManager::maxThreadCount() const
 {
-    qDebug() << "Running AI task for model" << modelIndex;
-    QThread::sleep(timeoutSeconds);
-    emit taskStatusChanged(modelIndex, static_cast<int>(AIStatus::Done), "Task completed");
-    qDebug() << "AI task for model" << modelIndex << "completed.";
+    return pool.maxThreadCount();
+}
+
+void AIPluginManager::setMaxQueuedTasks(int count)
+{
+    QMutexLocker locker(&mutex);
+    maxQueuedTasks = qMax(1, count);
 }
 
 void AIPluginManager::addPlugin(AIPlugin* plugin)
+{
+    if (!plugin)
+        return;
+    PluginInfo info;
+    info.name = plugin->getName();
+    info.version = plugin->getVersion();
+    info.outOfProcess = false;
+    info.initialized = false;
+    info.failed = false;
+    registerPlugin(plugin, info);
+    int modelIndex = pluginCount() - 1;
+    QMutexLocker pluginLocker(pluginLocks[modelIndex].get());
+    acquirePlugin(modelIndex);
+}
+
+bool AIPluginManager::addPluginPath(const QString& path, bool outOfProcess)
+{
+    // Reads the JSON embedded by Q_PLUGIN_METADATA without running plugin code.
+    QPluginLoader loader(path);
+    QJsonObject metaData = loader.metaData();
+    const QString iid = metaData.value("IID").toString();
+    if (iid != QLatin1String(AI_PLUGIN_IID))
+    {
+        if (iid.startsWith(QLatin1String("com.example.AIPluginInterface")))
+            qWarning() << "Plugin built against another AIPlugin interface:" << path << iid << "expected" << AI_PLUGIN_IID;
+        else
+            qWarning() << "Not an AIPlugin:" << path << loader.errorString();
+        return false;
+    }
+    QJsonObject fields = metaData.value("MetaData").toObject();
+    PluginInfo info;
+    info.path = path;
+    info.name = fields.value("name").toString(QFileInfo(path).completeBaseName()).toStdString();
+    info.version = fields.value("version").toString("1").toStdString();
+    info.outOfProcess = outOfProcess;
+    info.initialized = false;
+    info.failed = false;
+    registerPlugin(nullptr, info);
+    qDebug() << "Plugin registered:" << QString::fromStdString(info.name) << path << (outOfProcess ? "(hosted)" : "");
+    return true;
+}
+
+void AIPluginManager::setPluginHostExecutable(const QString& path)
+{
+    QMutexLocker locker(&mutex);
+    hostExecutable = path;
+}
+
+void AIPluginManager::initializePlugins()
+{
+    int count = pluginCount();
+    for (int i = 0; i < count; i++)
+    {
+        QtConcurrent::run(&pool,
+                          [this, i]()
+                          {
+                              QMutex* pluginLock;
+                              {
+                                  QMutexLocker locker(&mutex);
+                                  pluginLock = pluginLocks[i].get();
+                              }
+                              QMutexLocker pluginLocker(pluginLock);
+                              acquirePlugin(i);
+                          });
+    }
+}
+
+int AIPluginManager::pluginCount() const
+{
+    QMutexLocker locker(&mutex);
+    return static_cast<int>(plugins.size());
+}
+
+QString AIPluginManager::pluginName(int modelIndex) const
 {
     QMutexLocker locker(&mutex);
-    if (plugin)
+    if (modelIndex < 0 || modelIndex >= static_cast<int>(pluginInfo.size()))
+        return QString();
+    return QString::fromStdString(pluginInfo[modelIndex].name);
+}
+
+void AIPluginManager::registerPlugin(AIPlugin* plugin, const PluginInfo& info)
+{
+    QMutexLocker locker(&mutex);
+    plugins.push_back(plugin);
+    pluginInfo.push_back(info);
+    pluginLocks.emplace_back(new QMutex());
+    traceNames.push_back(QByteArray("plugin:") + QByteArray::fromStdString(info.name));
+    queues.emplace_back();
+    latestResults.emplace_back();
+    AIConfig defaultConfig;
+    defaultConfig.param1 = "";
+    defaultConfig.param2 = 0;
+    configs.push_back(defaultConfig);
+}
+
+AIPlugin* AIPluginManager::acquirePlugin(int modelIndex)
+{
+    // The caller holds the plugin's lock, so this runs at most once per plugin.
+    AIPlugin* plugin;
+    QString path;
+    QString host;
+    bool outOfProcess;
+    std::string name;
+    std::string version;
+    AIConfig config;
     {
-        plugins.push_back(plugin);
-        AIConfig defaultConfig;
-        defaultConfig.param1 = "";
-        defaultConfig.param2 = 0;
-        plugin->init(defaultConfig);
-        qDebug() << "Plugin added and initialized.";
+        QMutexLocker locker(&mutex);
+        const PluginInfo& info = pluginInfo[modelIndex];
+        if (info.initialized)
+            return plugins[modelIndex];
+        if (info.failed)
+            return nullptr;
+        plugin = plugins[modelIndex];
+        path = info.path;
+        outOfProcess = info.outOfProcess;
+        name = info.name;
+        version = info.version;
+        host = hostExecutable.isEmpty() ? QCoreApplication::applicationDirPath() + "/AIPluginHost" : hostExecutable;
+        config = configs[modelIndex];
     }
-}
\ No newline at end of file
+
+    TRACE_SCOPE("plugin_init");
+#ifdef Q_OS_UNIX
+    if (!plugin && outOfProcess)
+        plugin = new RemotePlugin(host, path, name, version);
+#else
+    if (outOfProcess)
+        qWarning() << "Out-of-process plugins are not supported on this platform, loading in process:" << path;
+#endif
+    if (!plugin)
+    {
+        QPluginLoader loader(path);
+        plugin = qobject_cast<AIPlugin*>(loader.instance());
+        if (!plugin)
+        {
+            qWarning() << "Failed to load plugin:" << path << loader.errorString();
+            QMutexLocker locker(&mutex);
+            pluginInfo[modelIndex].failed = true;
+            return nullptr;
+        }
+    }
+    try
+    {
+        plugin->init(config);
+    }
+    catch (const std::exception& e)
+    {
+        qWarning() << "init failed for model" << modelIndex << ":" << e.what();
+        QMutexLocker locker(&mutex);
+        plugins[modelIndex] = plugin;
+        pluginInfo[modelIndex].failed = true;
+        return nullptr;
+    }
+
+    QMutexLocker locker(&mutex);
+    plugins[modelIndex] = plugin;
+    pluginInfo[modelIndex].initialized = true;
+    qDebug() << "Plugin initialized:" << QString::fromStdString(pluginInfo[modelIndex].name);
+    return plugin;
+}
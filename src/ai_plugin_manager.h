@@ -8,13 +8,31 @@
 #define AI_PLUGIN_MANAGER_H
 
 #include "ai_plugin_interface.h"
-#include <QFuture>
-#include <QFutureWatcher>
+#include "result_cache.h"
+#include <QByteArray>
+#include <QList>
+#include <QMetaType>
 #include <QMutex>
 #include <QObject>
+#include <QRect>
+#include <QThreadPool>
+#include <deque>
+#include <functional>
+#include <memory>
 #include <opencv2/opencv.hpp>
 #include <vector>
 
+Q_DECLARE_METATYPE(cv::Mat)
+Q_DECLARE_METATYPE(cv::Mat3b)
+Q_DECLARE_METATYPE(AIResultPtr)
+
+// Fan-out/fan-in render graph: every branch is a serial chain fed the same
+// read-only input, and branch outputs are overlaid onto that input in order.
+using RenderGraph = std::vector<std::vector<int>>;
+
+// Runs plugin tasks on a bounded thread pool. Each plugin has its own FIFO
+// queue and executes one task at a time, so tasks for different plugins run
+// concurrently while a single plugin instance is never entered twice.
 class AIPluginManager : public QObject
 {
     Q_OBJECT
@@ -23,33 +41,160 @@ public:
     ~AIPluginManager();
 
     void loadModels(const QString& configPath);
-    const std::vector<AIPlugin*>& getPlugins() const { return plugins; }
+    int pluginCount() const;
+    // From the plugin's metadata; available before the plugin is loaded.
+    QString pluginName(int modelIndex) const;
 
-    void startTask(int modelIndex, const cv::Mat3b& image, int timeoutSeconds = 10);
+    // sourceKey identifies the input (see ResultCache::fileIdentity); when
+    // set, results are memoized and served from the cache on later calls.
+    void startTask(int modelIndex, const cv::Mat3b& image, int timeoutSeconds = 10, const QByteArray& sourceKey = QByteArray());
     void cancelTask(int modelIndex);
     void cancelAll();
     bool isTaskRunning() const;
+    bool isTaskRunning(int modelIndex) const;
+    // Registers an already created plugin and initializes it immediately.
     void addPlugin(AIPlugin* plugin);
+    // Registers a plugin library by its metadata only; it is loaded and
+    // initialized on first use or by initializePlugins. Returns false if the
+    // file carries no AIPlugin metadata. An out-of-process plugin runs in its
+    // own AIPluginHost, so a crash or hang cannot take the viewer down.
+    bool addPluginPath(const QString& path, bool outOfProcess = false);
+    // Defaults to AIPluginHost next to the application binary.
+    void setPluginHostExecutable(const QString& path);
+    // Loads and initializes every registered plugin in parallel on the pool.
+    void initializePlugins();
+    void updateConfig(int modelIndex, const AIConfig& config);
+    ResultCache& resultCache() { return results; }
+    // Per-stage outputs of keyed renders, memory only. Set its budget to cap
+    // what incremental re-execution retains.
+    ResultCache& intermediateCache() { return intermediates; }
+    // Result the plugin published during its last completed task, shared, not copied.
+    AIResultPtr latestResult(int modelIndex) const;
+
+    // Runs render_result on the calling thread while holding the plugin's lock.
+    bool renderResult(int modelIndex, const cv::Mat& input, cv::Mat& output, const AICancelToken* token = nullptr);
+
+    // Same as renderResult for render_region; false if the plugin has no region path.
+    bool renderRegion(int modelIndex, const cv::Mat& input, const cv::Rect& roi, double scale, cv::Mat& output, const AICancelToken* token = nullptr);
+
+    // Runs the render chain on a worker and posts the final frame through
+    // renderFinished. A new request cancels the running one and replaces any
+    // pending one, so only the latest request is ever delivered. With a
+    // previewRoi, the chain first runs over that region at previewScale and
+    // posts it through regionRendered before the full-resolution pass, unless
+    // the full result is cached or a stage does not support regions.
+    void startRender(quint64 requestId,
+                     const cv::Mat& image,
+                     const std::vector<int>& modelIndices,
+                     const QByteArray& sourceKey = QByteArray(),
+                     const cv::Rect& previewRoi = cv::Rect(),
+                     double previewScale = 1.0);
+    // startRender for a graph. Branches run concurrently on the pool, so N
+    // independent plugins take about as long as the slowest one.
+    void startRenderGraph(quint64 requestId, const cv::Mat& image, const RenderGraph& graph, const QByteArray& sourceKey = QByteArray());
+    void cancelRender();
+
+    // Runs image through modelIndices in order on the calling thread. Stages
+    // alternate between the two buffers instead of allocating per stage; a
+    // buffer still referenced by someone else is detached before reuse.
+    // Empty if canceled or if any stage fails.
+    cv::Mat renderChain(const cv::Mat& image, const std::vector<int>& modelIndices, const AICancelToken* token, cv::Mat buffers[2]);
+    // Runs graph on the calling thread and the pool; see startRenderGraph.
+    // Empty if canceled or if any branch fails.
+    cv::Mat renderGraph(const cv::Mat& image, const RenderGraph& graph, const AICancelToken* token);
+    // Copies each layer over base where it differs from base, so results of
+    // independent branches stack instead of replacing each other.
+    static cv::Mat overlay(const cv::Mat& base, const std::vector<cv::Mat>& layers);
+    // The first stage crops and scales; later stages see its whole output.
+    cv::Mat renderRegionChain(const cv::Mat& image, const std::vector<int>& modelIndices, const cv::Rect& roi, double scale, const AICancelToken* token);
+
+    void setMaxThreadCount(int count);
+    int maxThreadCount() const;
+    void setMaxQueuedTasks(int count);
 
 signals:
     void taskStarted(int modelIndex);
     void taskFinished(int modelIndex, const cv::Mat3b& result);
+    void resultPublished(int modelIndex, const AIResultPtr& result);
     void taskStatusChanged(int modelIndex, int status, const QString& msg);
+    void renderFinished(quint64 requestId, const cv::Mat& result);
+    // result covers roi of the source image at a reduced scale.
+    void regionRendered(quint64 requestId, const cv::Mat& result, const QRect& roi);
 
 private:
     struct Task
     {
         int modelIndex;
-        QFuture<void> future;
-        QFutureWatcher<void>* watcher;
-        bool running;
+        cv::Mat3b image;
+        int timeoutSeconds;
+        QByteArray cacheKey;
+        std::shared_ptr<AICancelToken> token;
+    };
+
+    struct PluginQueue
+    {
+        std::deque<Task> pending;
+        std::shared_ptr<AICancelToken> active;
+    };
+
+    struct PluginInfo
+    {
+        QString path;
+        std::string name;
+        std::string version;
+        bool outOfProcess;
+        bool initialized;
+        bool failed;
     };
 
+    // plugins[i] stays nullptr until a lazily registered plugin is first used.
     std::vector<AIPlugin*> plugins;
-    std::vector<Task> tasks;
+    std::vector<PluginInfo> pluginInfo;
+    std::vector<std::unique_ptr<QMutex>> pluginLocks;
+    // Span names for tracing; a deque so the strings never move.
+    std::deque<QByteArray> traceNames;
+    std::vector<AIConfig> configs;
+    std::vector<AIResultPtr> latestResults;
+    ResultCache results;
+    ResultCache intermediates;
+    struct RenderRequest
+    {
+        quint64 requestId;
+        cv::Mat image;
+        std::vector<int> modelIndices;
+        QByteArray cacheKey;
+        // Key of each chain prefix; empty when the source is not keyed.
+        QList<QByteArray> stageKeys;
+        // Set instead of modelIndices for graph renders.
+        RenderGraph graph;
+        std::vector<QList<QByteArray>> branchKeys;
+        cv::Rect previewRoi;
+        double previewScale;
+    };
+
+    std::vector<PluginQueue> queues;
+    RenderRequest pendingRender;
+    bool renderPending;
+    std::shared_ptr<AICancelToken> activeRender;
+    cv::Mat renderBuffers[2];
+    int maxQueuedTasks;
+    QString hostExecutable;
+    QThreadPool pool;
     mutable QMutex mutex;
 
-    void runTask(int modelIndex, cv::Mat3b image, int timeoutSeconds);
+    QByteArray cacheKey(const QByteArray& sourceKey, const std::vector<int>& modelIndices) const;
+    QList<QByteArray> stageKeys(const QByteArray& sourceKey, const std::vector<int>& modelIndices) const;
+    // Caller holds mutex.
+    QByteArray stageIdentity(int modelIndex) const;
+    cv::Mat renderIncremental(const cv::Mat& image, const std::vector<int>& modelIndices, const QList<QByteArray>& keys, const AICancelToken* token);
+    cv::Mat runGraph(const cv::Mat& image, const RenderGraph& graph, const std::vector<QList<QByteArray>>& branchKeys, const AICancelToken* token);
+    AIPlugin* acquirePlugin(int modelIndex);
+    void registerPlugin(AIPlugin* plugin, const PluginInfo& info);
+    bool callPlugin(int modelIndex, const AICancelToken* token, const char* what, const std::function<bool(AIPlugin*)>& call);
+    void dispatch(int modelIndex);
+    void runTask(const Task& task);
+    void dispatchRender();
+    void runRender(const RenderRequest& request, const std::shared_ptr<AICancelToken>& token);
 };
 
 #endif // AI_PLUGIN_MANAGER_H
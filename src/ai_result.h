@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef AI_RESULT_H
+#define AI_RESULT_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct AIBox
+{
+    cv::Rect2f rect;
+    float score = 0.0f;
+    int classId = -1;
+    std::string label;
+};
+
+// Mutable staging area a plugin fills before publishing.
+struct AIResultData
+{
+    cv::Mat image;
+    // Single channel, same size as the input; 0 means background.
+    cv::Mat mask;
+    std::vector<AIBox> boxes;
+    std::map<std::string, double> scalars;
+};
+
+class AIResult;
+using AIResultPtr = std::shared_ptr<const AIResult>;
+
+// An immutable, reference-counted plugin result. Any number of consumers on
+// any thread may hold it; the Mats share the publisher's buffers, so the
+// publisher must not write to a buffer once it has been published (detach
+// with release() when refcount > 1 instead, as HSVPlugin does).
+class AIResult
+{
+public:
+    AIResult(std::string producer, uint64_t sequence, AIResultData data) : producer_(std::move(producer)), sequence_(sequence), data_(std::move(data)) {}
+
+    static AIResultPtr publish(const std::string& producer, uint64_t sequence, AIResultData data) { return std::make_shared<const AIResult>(producer, sequence, std::move(data)); }
+
+    const std::string& producer() const { return producer_; }
+    // Increases with every result a plugin instance publishes.
+    uint64_t sequence() const { return sequence_; }
+    const cv::Mat& image() const { return data_.image; }
+    const cv::Mat& mask() const { return data_.mask; }
+    const std::vector<AIBox>& boxes() const { return data_.boxes; }
+    const std::map<std::string, double>& scalars() const { return data_.scalars; }
+
+private:
+    const std::string producer_;
+    const uint64_t sequence_;
+    const AIResultData data_;
+};
+
+#endif // AI_RESULT_H
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "app_config.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QTextStream>
+
+QString defaultConfigPath()
+{
+    // tmp yaml file path
+    return QDir::currentPath() + "/../config/config.yaml";
+}
+
+bool loadAppConfig(const QString& configPath, AppConfig& config)
+{
+    QFile configFile(configPath);
+    if (!configFile.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        qWarning() << "Failed to open config file:" << configPath;
+        return false;
+    }
+
+    QTextStream in(&configFile);
+    while (!in.atEnd())
+    {
+        QString line = in.readLine().trimmed();
+        QStringList parts = line.split(":");
+        if (parts.size() != 2)
+            continue;
+        QString value = parts[1].trimmed();
+        if (line.startsWith("- pluginpath:") || line.startsWith("- hostpath:"))
+        {
+            qDebug() << "Plugin path found:" << value;
+            if (QDir::isRelativePath(value))
+                value = QDir::current().absoluteFilePath(value);
+            config.pluginPaths << value;
+            if (line.startsWith("- hostpath:"))
+                config.hostedPluginPaths << value;
+        }
+        else if (line.startsWith("- cache_mb:"))
+        {
+            config.cacheBytes = value.toLongLong() * 1024 * 1024;
+        }
+        else if (line.startsWith("- prefetch:"))
+        {
+            config.prefetch = value.toInt();
+        }
+        else if (line.startsWith("- frame_pool_mb:"))
+        {
+            config.framePoolBytes = value.toLongLong() * 1024 * 1024;
+        }
+        else if (line.startsWith("- result_cache_mb:"))
+        {
+            config.resultCacheBytes = value.toLongLong() * 1024 * 1024;
+        }
+        else if (line.startsWith("- result_cache_dir:"))
+        {
+            if (!value.isEmpty() && QDir::isRelativePath(value))
+                value = QDir::current().absoluteFilePath(value);
+            config.resultCacheDir = value;
+        }
+        else if (line.startsWith("- preload_plugins:"))
+        {
+            config.preloadPlugins = value != "false";
+        }
+        else if (line.startsWith("- result_cache_disk_mb:"))
+        {
+            config.resultCacheDiskBytes = value.toLongLong() * 1024 * 1024;
+        }
+        else if (line.startsWith("- intermediate_cache_mb:"))
+        {
+            config.intermediateCacheBytes = value.toLongLong() * 1024 * 1024;
+        }
+        else if (line.startsWith("- openexr:"))
+        {
+            config.openExr = value == "true";
+        }
+    }
+    configFile.close();
+    return true;
+}
+
+void applyCodecConfig(const AppConfig& config)
+{
+    // OpenCV reads the variable once, on its first EXR decode.
+    if (config.openExr && !qEnvironmentVariableIsSet("OPENCV_IO_ENABLE_OPENEXR"))
+        qputenv("OPENCV_IO_ENABLE_OPENEXR", "1");
+}
+
+int loadPlugins(const AppConfig& config, AIPluginManager* manager)
+{
+    manager->resultCache().setMemoryBudget(config.resultCacheBytes);
+    manager->resultCache().setDiskDirectory(config.resultCacheDir, config.resultCacheDiskBytes);
+    manager->intermediateCache().setMemoryBudget(config.intermediateCacheBytes);
+
+    // Only metadata is read here; instances are created and initialized on
+    // the manager's pool, or on first use when preloading is off.
+    int registered = 0;
+    for (const QString& pluginPath : config.pluginPaths)
+    {
+        if (manager->addPluginPath(pluginPath, config.hostedPluginPaths.contains(pluginPath)))
+            registered++;
+    }
+    if (config.preloadPlugins)
+        manager->initializePlugins();
+    return registered;
+}
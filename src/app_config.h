@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef APP_CONFIG_H
+#define APP_CONFIG_H
+
+#include "ai_plugin_manager.h"
+#include <QString>
+#include <QStringList>
+
+// Settings read from config/config.yaml, shared by the viewer and the
+// headless batch tool.
+struct AppConfig
+{
+    QStringList pluginPaths;
+    // Subset of pluginPaths that each run in their own AIPluginHost process.
+    QStringList hostedPluginPaths;
+    qint64 cacheBytes = 512LL * 1024 * 1024;
+    int prefetch = 2;
+    // Idle frame buffers kept for reuse; 0 disables the frame pool.
+    qint64 framePoolBytes = 256LL * 1024 * 1024;
+    qint64 resultCacheBytes = 256LL * 1024 * 1024;
+    // Empty keeps plugin results in memory only.
+    QString resultCacheDir;
+    qint64 resultCacheDiskBytes = 4LL * 1024 * 1024 * 1024;
+    // Per-stage chain outputs kept so a changed stage reruns only itself and later stages.
+    qint64 intermediateCacheBytes = 128LL * 1024 * 1024;
+    // Initialize plugins in the background at startup instead of on first use.
+    bool preloadPlugins = true;
+    // OpenCV's EXR decoder is off by default for security reasons.
+    bool openExr = false;
+};
+
+QString defaultConfigPath();
+bool loadAppConfig(const QString& configPath, AppConfig& config);
+// Enables optional OpenCV decoders; call before the first decode. An
+// environment variable the user set explicitly is left alone.
+void applyCodecConfig(const AppConfig& config);
+// Registers every configured plugin; returns how many carry valid metadata.
+int loadPlugins(const AppConfig& config, AIPluginManager* manager);
+
+#endif // APP_CONFIG_H
@@ -0,0 +1,344 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QThread>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <opencv2/opencv.hpp>
+#include <thread>
+#include <vector>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+#include "ai_plugin_manager.h"
+#include "app_config.h"
+#include "bounded_queue.h"
+#include "frame_pool.h"
+#include "image_cache.h"
+#include "tone_map.h"
+
+struct BatchItem
+{
+    QString path;
+    QString outPath;
+    cv::Mat image;
+};
+
+class StageStats
+{
+public:
+    explicit StageStats(const char* name) : name(name) {}
+
+    void add(double ms)
+    {
+        QMutexLocker locker(&mutex);
+        samples.push_back(ms);
+    }
+
+    void print()
+    {
+        QMutexLocker locker(&mutex);
+        if (samples.empty())
+        {
+            std::printf("  %-8s no samples\n", name);
+            return;
+        }
+        std::sort(samples.begin(), samples.end());
+        double sum = 0.0;
+        for (double s : samples)
+            sum += s;
+        std::printf("  %-8s mean %8.2f ms  p50 %8.2f ms  p95 %8.2f ms  max %8.2f ms\n",
+                    name,
+                    sum / samples.size(),
+                    percentile(0.50),
+                    percentile(0.95),
+                    samples.back());
+    }
+
+private:
+    double percentile(double p) const { return samples[std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()))]; }
+
+    const char* name;
+    std::vector<double> samples;
+    QMutex mutex;
+};
+
+static long peakRssKiB()
+{
+#ifdef Q_OS_UNIX
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+#ifdef Q_OS_MACOS
+        // Bytes on macOS, KiB elsewhere.
+        return usage.ru_maxrss / 1024;
+#else
+        return usage.ru_maxrss;
+#endif
+    }
+#endif
+    return -1;
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("AIPluginBatch");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Runs the configured plugin chain over every image in a directory.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("input", "Directory of input images.");
+    parser.addPositionalArgument("output", "Directory for the rendered images.");
+    QCommandLineOption configOption("config", "Path to config.yaml.", "path", defaultConfigPath());
+    QCommandLineOption pluginsOption("plugins", "Comma-separated plugin names to chain, in order (default: all).", "names");
+    QCommandLineOption graphOption("graph",
+                                   "Parallel branches separated by ';', each a comma-separated chain; branch outputs are overlaid. Overrides --plugins.",
+                                   "branches");
+    QCommandLineOption decodeOption("decode-threads", "Number of decode workers.", "n", QString::number(qMax(1, QThread::idealThreadCount() / 2)));
+    QCommandLineOption encodeOption("encode-threads", "Number of encode workers.", "n", QString::number(qMax(1, QThread::idealThreadCount() / 2)));
+    QCommandLineOption queueOption("queue-depth", "Capacity of each inter-stage queue.", "n", "8");
+    QCommandLineOption formatOption("format", "Output extension, e.g. png or jpg (default: keep the input's).", "ext");
+    parser.addOptions({configOption, pluginsOption, graphOption, decodeOption, encodeOption, queueOption, formatOption});
+    parser.process(app);
+
+    const QStringList positional = parser.positionalArguments();
+    if (positional.size() != 2)
+        parser.showHelp(1);
+    QDir inputDir(positional[0]);
+    QDir outputDir(positional[1]);
+    if (!inputDir.exists())
+    {
+        qWarning() << "Input directory does not exist:" << inputDir.path();
+        return 1;
+    }
+    if (!outputDir.exists() && !QDir().mkpath(outputDir.path()))
+    {
+        qWarning() << "Failed to create output directory:" << outputDir.path();
+        return 1;
+    }
+
+    AIPluginManager manager;
+    AppConfig config;
+    bool configLoaded = loadAppConfig(parser.value(configOption), config);
+    applyCodecConfig(config);
+    FramePool::install(config.framePoolBytes);
+    if (!configLoaded || loadPlugins(config, &manager) == 0)
+    {
+        qWarning() << "No plugins loaded.";
+        return 1;
+    }
+
+    const int pluginCount = manager.pluginCount();
+    auto parseChain = [&](const QString& names, std::vector<int>& chain)
+    {
+        for (const QString& name : names.split(','))
+        {
+            if (name.trimmed().isEmpty())
+                continue;
+            int index = 0;
+            while (index < pluginCount && manager.pluginName(index) != name.trimmed())
+                index++;
+            if (index == pluginCount)
+            {
+                qWarning() << "Unknown plugin:" << name;
+                return false;
+            }
+            chain.push_back(index);
+        }
+        return true;
+    };
+
+    std::vector<int> chain;
+    RenderGraph graph;
+    if (parser.isSet(graphOption))
+    {
+        for (const QString& branch : parser.value(graphOption).split(';'))
+        {
+            graph.emplace_back();
+            if (!parseChain(branch, graph.back()))
+                return 1;
+        }
+    }
+    else if (parser.isSet(pluginsOption))
+    {
+        if (!parseChain(parser.value(pluginsOption), chain))
+            return 1;
+    }
+    else
+    {
+        for (int i = 0; i < pluginCount; i++)
+            chain.push_back(i);
+    }
+
+    QStringList files;
+    QDirIterator it(inputDir.path(), QStringList() << "*.png" << "*.jpg" << "*.jpeg" << "*.bmp" << "*.tif" << "*.tiff" << "*.exr", QDir::Files);
+    while (it.hasNext())
+        files << it.next();
+    files.sort();
+
+    const int decodeThreads = qMax(1, parser.value(decodeOption).toInt());
+    const int encodeThreads = qMax(1, parser.value(encodeOption).toInt());
+    const size_t queueDepth = static_cast<size_t>(qMax(1, parser.value(queueOption).toInt()));
+    const QString format = parser.value(formatOption);
+
+    // Output paths are fixed up front, since parallel encoders must never share
+    // one. Inputs that would collide (a.png and a.tif with --format jpg) keep
+    // their source suffix in the name: a_png.jpg and a_tif.jpg.
+    auto outputName = [&](const QFileInfo& info, bool keepSuffix)
+    {
+        QString base = keepSuffix ? info.completeBaseName() + "_" + info.suffix() : info.completeBaseName();
+        return outputDir.filePath(base + "." + (format.isEmpty() ? info.suffix() : format));
+    };
+    QStringList outPaths;
+    QHash<QString, int> outUses;
+    for (const QString& file : files)
+    {
+        outPaths << outputName(QFileInfo(file), false);
+        outUses[outPaths.back()]++;
+    }
+    QSet<QString> claimed;
+    for (int i = 0; i < files.size(); i++)
+    {
+        if (outUses[outPaths[i]] > 1)
+            outPaths[i] = outputName(QFileInfo(files[i]), true);
+        if (claimed.contains(outPaths[i]))
+        {
+            qWarning() << "Two inputs map to the same output" << outPaths[i];
+            return 1;
+        }
+        claimed.insert(outPaths[i]);
+    }
+
+    BoundedQueue<BatchItem> decoded(queueDepth);
+    BoundedQueue<BatchItem> rendered(queueDepth);
+    StageStats decodeStats("decode");
+    StageStats pluginStats("plugins");
+    StageStats encodeStats("encode");
+    std::atomic<int> nextFile(0);
+    std::atomic<int> failures(0);
+    std::atomic<int> written(0);
+
+    QElapsedTimer wallClock;
+    wallClock.start();
+
+    std::vector<std::thread> decoders;
+    for (int t = 0; t < decodeThreads; t++)
+    {
+        decoders.emplace_back(
+            [&]()
+            {
+                for (int i = nextFile++; i < files.size(); i = nextFile++)
+                {
+                    QElapsedTimer timer;
+                    timer.start();
+                    BatchItem item;
+                    item.path = files[i];
+                    item.outPath = outPaths[i];
+                    // High-bit-depth inputs are mapped to 8 bits the way the viewer shows them.
+                    item.image = toBgr8(ImageCache::decode(item.path));
+                    decodeStats.add(timer.nsecsElapsed() / 1e6);
+                    if (item.image.empty())
+                    {
+                        qWarning() << "Failed to decode" << item.path;
+                        failures++;
+                        continue;
+                    }
+                    if (!decoded.push(std::move(item)))
+                        return;
+                }
+            });
+    }
+
+    // Plugin instances are not reentrant, so the chain itself runs on one thread
+    // and overlaps with decode and encode instead of with itself. Graph
+    // branches additionally run in parallel on the manager's pool.
+    std::thread renderer(
+        [&]()
+        {
+            cv::Mat buffers[2];
+            BatchItem item;
+            while (decoded.pop(item))
+            {
+                QElapsedTimer timer;
+                timer.start();
+                if (graph.empty())
+                    item.image = manager.renderChain(item.image, chain, nullptr, buffers);
+                else
+                    item.image = manager.renderGraph(item.image, graph, nullptr);
+                pluginStats.add(timer.nsecsElapsed() / 1e6);
+                if (item.image.empty())
+                {
+                    qWarning() << "Plugins failed for" << item.path;
+                    failures++;
+                    continue;
+                }
+                if (!rendered.push(std::move(item)))
+                    return;
+            }
+        });
+
+    std::vector<std::thread> encoders;
+    for (int t = 0; t < encodeThreads; t++)
+    {
+        encoders.emplace_back(
+            [&]()
+            {
+                BatchItem item;
+                while (rendered.pop(item))
+                {
+                    QElapsedTimer timer;
+                    timer.start();
+                    const QString& outPath = item.outPath;
+                    bool ok = !item.image.empty() && cv::imwrite(outPath.toStdString(), item.image);
+                    encodeStats.add(timer.nsecsElapsed() / 1e6);
+                    if (ok)
+                    {
+                        written++;
+                    }
+                    else
+                    {
+                        qWarning() << "Failed to write" << outPath;
+                        failures++;
+                    }
+                }
+            });
+    }
+
+    for (auto& t : decoders)
+        t.join();
+    decoded.close();
+    renderer.join();
+    rendered.close();
+    for (auto& t : encoders)
+        t.join();
+
+    double seconds = wallClock.nsecsElapsed() / 1e9;
+    std::printf("Processed %d/%d images in %.2f s (%.2f images/s)\n", written.load(), files.size(), seconds, seconds > 0 ? written.load() / seconds : 0.0);
+    decodeStats.print();
+    pluginStats.print();
+    encodeStats.print();
+    const FramePool::Stats pool = FramePool::instance()->stats();
+    std::printf("  frame pool %llu hits, %llu misses, %lld MiB held\n",
+                static_cast<unsigned long long>(pool.hits),
+                static_cast<unsigned long long>(pool.misses),
+                static_cast<long long>(pool.bytesHeld / (1024 * 1024)));
+    std::printf("  peak RSS %ld KiB\n", peakRssKiB());
+    return failures.load() == 0 ? 0 : 2;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <deque>
+#include <utility>
+
+// Blocking multi-producer/multi-consumer queue with a fixed capacity, used to
+// apply back-pressure between pipeline stages. close() wakes every waiter;
+// pop() keeps draining remaining items and returns false once empty.
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity > 0 ? capacity : 1), closed(false) {}
+
+    bool push(T item)
+    {
+        QMutexLocker locker(&mutex);
+        while (items.size() >= capacity && !closed)
+            notFull.wait(&mutex);
+        if (closed)
+            return false;
+        items.push_back(std::move(item));
+        notEmpty.wakeOne();
+        return true;
+    }
+
+    bool pop(T& item)
+    {
+        QMutexLocker locker(&mutex);
+        while (items.empty() && !closed)
+            notEmpty.wait(&mutex);
+        if (items.empty())
+            return false;
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.wakeOne();
+        return true;
+    }
+
+    void close()
+    {
+        QMutexLocker locker(&mutex);
+        closed = true;
+        notEmpty.wakeAll();
+        notFull.wakeAll();
+    }
+
+    size_t size() const
+    {
+        QMutexLocker locker(&mutex);
+        return items.size();
+    }
+
+private:
+    std::deque<T> items;
+    size_t capacity;
+    bool closed;
+    mutable QMutex mutex;
+    QWaitCondition notEmpty;
+    QWaitCondition notFull;
+};
+
+#endif // BOUNDED_QUEUE_H
@@ -0,0 +1,431 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "color_index.h"
+#include "image_cache.h"
+#include "plugins/hsv/hsv_kernel.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <opencv2/core/hal/intrin.hpp>
+
+namespace
+{
+    struct IndexHeader
+    {
+        char magic[8];
+        quint32 version;
+        quint32 binCount;
+        qint32 rowCount;
+        quint32 reserved;
+    };
+
+    const char indexMagic[8] = {'A', 'I', 'V', 'C', 'O', 'L', 'I', 'X'};
+    const quint32 indexVersion = 2;
+    const int rowsPerSegment = 65536;
+    const qint64 headerBytes = 4096;
+    // Column offsets within a segment: hashes, file stamps, histograms,
+    // clipped shares.
+    const qint64 hashColumn = 0;
+    const qint64 modifiedColumn = hashColumn + rowsPerSegment * static_cast<qint64>(sizeof(quint64));
+    const qint64 sizeColumn = modifiedColumn + rowsPerSegment * static_cast<qint64>(sizeof(qint64));
+    const qint64 histogramColumnOffset = sizeColumn + rowsPerSegment * static_cast<qint64>(sizeof(qint64));
+    const qint64 clippedColumn = histogramColumnOffset + rowsPerSegment * static_cast<qint64>(ColorIndex::binCount);
+    const qint64 segmentBytes = clippedColumn + rowsPerSegment;
+    // Resolution the histogram is taken at; enough for a 64-bin estimate.
+    const int sampleSize = 128;
+    const int clippedValue = 250;
+
+    struct DistanceKernel
+    {
+        explicit DistanceKernel(const ColorIndex::Histogram& query) : query(query)
+        {
+#if CV_SIMD128
+            for (int i = 0; i < 4; i++)
+                q[i] = cv::v_load(query.data() + i * 16);
+#endif
+        }
+
+        quint16 operator()(const uchar* row) const
+        {
+#if CV_SIMD128
+            unsigned sum = cv::v_reduce_sad(cv::v_load(row), q[0]) + cv::v_reduce_sad(cv::v_load(row + 16), q[1]) + cv::v_reduce_sad(cv::v_load(row + 32), q[2]) +
+                           cv::v_reduce_sad(cv::v_load(row + 48), q[3]);
+            return static_cast<quint16>(sum);
+#else
+            int sum = 0;
+            for (int b = 0; b < ColorIndex::binCount; b++)
+                sum += std::abs(row[b] - query[b]);
+            return static_cast<quint16>(sum);
+#endif
+        }
+
+        const ColorIndex::Histogram& query;
+#if CV_SIMD128
+        cv::v_uint8x16 q[4];
+#endif
+    };
+
+    struct MassKernel
+    {
+        explicit MassKernel(const ColorIndex::Histogram& mask) : mask(mask)
+        {
+#if CV_SIMD128
+            for (int i = 0; i < 4; i++)
+                m[i] = cv::v_load(mask.data() + i * 16);
+#endif
+        }
+
+        quint16 operator()(const uchar* row) const
+        {
+#if CV_SIMD128
+            const cv::v_uint8x16 zero = cv::v_setzero_u8();
+            unsigned sum = cv::v_reduce_sad(cv::v_load(row) & m[0], zero) + cv::v_reduce_sad(cv::v_load(row + 16) & m[1], zero) +
+                           cv::v_reduce_sad(cv::v_load(row + 32) & m[2], zero) + cv::v_reduce_sad(cv::v_load(row + 48) & m[3], zero);
+            return static_cast<quint16>(sum);
+#else
+            int sum = 0;
+            for (int b = 0; b < ColorIndex::binCount; b++)
+                sum += row[b] & mask[b];
+            return static_cast<quint16>(sum);
+#endif
+        }
+
+        const ColorIndex::Histogram& mask;
+#if CV_SIMD128
+        cv::v_uint8x16 m[4];
+#endif
+    };
+} // namespace
+
+ColorIndex::ColorIndex() : header(nullptr), rowCount(0)
+{
+    static_assert(sizeof(IndexHeader) == 24, "header layout");
+}
+
+ColorIndex::~ColorIndex()
+{
+    close();
+}
+
+QString ColorIndex::indexPath(const QString& directory)
+{
+    QByteArray digest = QCryptographicHash::hash(QDir(directory).absolutePath().toUtf8(), QCryptographicHash::Sha1).toHex();
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/colorindex/" + QString::fromLatin1(digest) + ".colidx";
+}
+
+bool ColorIndex::compute(const QString& path, Entry& entry)
+{
+    QFileInfo info(path);
+    if (!info.exists())
+        return false;
+    entry.modified = info.lastModified().toMSecsSinceEpoch();
+    entry.size = info.size();
+    cv::Mat image = ImageCache::decodePreview(path);
+    if (image.empty())
+        return false;
+    if (std::max(image.cols, image.rows) > sampleSize)
+    {
+        double scale = static_cast<double>(sampleSize) / std::max(image.cols, image.rows);
+        cv::Mat small;
+        cv::resize(image, small, cv::Size(std::max(1, cvRound(image.cols * scale)), std::max(1, cvRound(image.rows * scale))), 0, 0, cv::INTER_AREA);
+        image = small;
+    }
+    cv::Mat hsv;
+    bgrToHsv(image, hsv);
+
+    int counts[binCount] = {};
+    int clipped = 0;
+    for (int y = 0; y < hsv.rows; y++)
+    {
+        const uchar* p = hsv.ptr<uchar>(y);
+        for (int x = 0; x < hsv.cols; x++, p += 3)
+        {
+            // OpenCV's 8-bit hue runs from 0 to 179.
+            counts[bin(std::min(p[0] * hueBins / 180, hueBins - 1), p[1] * satBins / 256, p[2] * valBins / 256)]++;
+            clipped += p[2] >= clippedValue;
+        }
+    }
+    const double scale = 255.0 / hsv.total();
+    for (int b = 0; b < binCount; b++)
+        entry.histogram[b] = cv::saturate_cast<uchar>(counts[b] * scale);
+    entry.clipped = cv::saturate_cast<uchar>(clipped * scale);
+    return true;
+}
+
+bool ColorIndex::open(const QString& directory)
+{
+    close();
+    QMutexLocker locker(&mutex);
+    QString path = indexPath(directory);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadWrite))
+    {
+        qWarning() << "Failed to open color index" << path;
+        return false;
+    }
+
+    IndexHeader h;
+    bool fresh = file.size() < headerBytes || file.read(reinterpret_cast<char*>(&h), sizeof(h)) != sizeof(h) || std::memcmp(h.magic, indexMagic, sizeof(indexMagic)) != 0 ||
+                 h.version != indexVersion || h.binCount != static_cast<quint32>(binCount) || h.rowCount < 0 ||
+                 headerBytes + ((h.rowCount + rowsPerSegment - 1) / rowsPerSegment) * segmentBytes > file.size();
+    if (fresh)
+    {
+        std::memset(&h, 0, sizeof(h));
+        std::memcpy(h.magic, indexMagic, sizeof(indexMagic));
+        h.version = indexVersion;
+        h.binCount = binCount;
+        if (!file.resize(0) || !file.resize(headerBytes) || !file.seek(0) || file.write(reinterpret_cast<const char*>(&h), sizeof(h)) != sizeof(h) || !file.flush())
+        {
+            qWarning() << "Failed to initialize color index" << path;
+            file.close();
+            return false;
+        }
+    }
+
+    header = file.map(0, headerBytes);
+    if (!header)
+    {
+        file.close();
+        return false;
+    }
+    int segmentCount = (h.rowCount + rowsPerSegment - 1) / rowsPerSegment;
+    for (int s = 0; s < segmentCount; s++)
+    {
+        uchar* segment = file.map(headerBytes + s * segmentBytes, segmentBytes);
+        if (!segment)
+            break;
+        segments.push_back(segment);
+    }
+    rowCount = std::min(h.rowCount, static_cast<int>(segments.size()) * rowsPerSegment);
+    // A later row for the same name supersedes an earlier one.
+    for (int i = 0; i < rowCount; i++)
+    {
+        const quint64* hashes = reinterpret_cast<const quint64*>(segments[i / rowsPerSegment] + hashColumn);
+        rows.insert(hashes[i % rowsPerSegment], i);
+    }
+    return true;
+}
+
+void ColorIndex::close()
+{
+    QMutexLocker locker(&mutex);
+    if (!file.isOpen())
+        return;
+    for (uchar* segment : segments)
+        file.unmap(segment);
+    segments.clear();
+    if (header)
+        file.unmap(header);
+    header = nullptr;
+    file.close();
+    rows.clear();
+    rowCount = 0;
+}
+
+bool ColorIndex::isOpen() const
+{
+    QMutexLocker locker(&mutex);
+    return header != nullptr;
+}
+
+bool ColorIndex::isCurrent(const QByteArray& name, const QString& path) const
+{
+    QFileInfo info(path);
+    if (!info.exists())
+        return false;
+    const qint64 modified = info.lastModified().toMSecsSinceEpoch();
+    QMutexLocker locker(&mutex);
+    auto it = rows.find(hashName(name));
+    if (it == rows.end())
+        return false;
+    const uchar* segment = segments[it.value() / rowsPerSegment];
+    const int row = it.value() % rowsPerSegment;
+    return reinterpret_cast<const qint64*>(segment + modifiedColumn)[row] == modified && reinterpret_cast<const qint64*>(segment + sizeColumn)[row] == info.size();
+}
+
+bool ColorIndex::lookup(const QByteArray& name, Entry& entry) const
+{
+    QMutexLocker locker(&mutex);
+    auto it = rows.find(hashName(name));
+    if (it == rows.end())
+        return false;
+    const uchar* segment = segments[it.value() / rowsPerSegment];
+    const int row = it.value() % rowsPerSegment;
+    std::memcpy(entry.histogram.data(), segment + histogramColumnOffset + row * binCount, binCount);
+    entry.clipped = segment[clippedColumn + row];
+    entry.modified = reinterpret_cast<const qint64*>(segment + modifiedColumn)[row];
+    entry.size = reinterpret_cast<const qint64*>(segment + sizeColumn)[row];
+    return true;
+}
+
+bool ColorIndex::store(const QByteArray& name, const Entry& entry)
+{
+    if (entry.size < 0)
+        return false;
+    QMutexLocker locker(&mutex);
+    if (!header)
+        return false;
+    if (rowCount == static_cast<int>(segments.size()) * rowsPerSegment && !addSegment())
+        return false;
+
+    const int index = rowCount;
+    uchar* segment = segments[index / rowsPerSegment];
+    const int row = index % rowsPerSegment;
+    const quint64 hash = hashName(name);
+    std::memcpy(segment + histogramColumnOffset + row * binCount, entry.histogram.data(), binCount);
+    segment[clippedColumn + row] = entry.clipped;
+    reinterpret_cast<qint64*>(segment + modifiedColumn)[row] = entry.modified;
+    reinterpret_cast<qint64*>(segment + sizeColumn)[row] = entry.size;
+    reinterpret_cast<quint64*>(segment + hashColumn)[row] = hash;
+
+    rowCount++;
+    reinterpret_cast<IndexHeader*>(header)->rowCount = rowCount;
+    rows.insert(hash, index);
+    return true;
+}
+
+int ColorIndex::count() const
+{
+    QMutexLocker locker(&mutex);
+    return rows.size();
+}
+
+std::vector<int> ColorIndex::rowsFor(const ImageList& list) const
+{
+    QMutexLocker locker(&mutex);
+    std::vector<int> result(list.size(), -1);
+    for (int i = 0; i < list.size(); i++)
+    {
+        auto it = rows.find(hashName(QByteArray::fromRawData(list.name(i), static_cast<int>(std::strlen(list.name(i))))));
+        if (it != rows.end())
+            result[i] = it.value();
+    }
+    return result;
+}
+
+template <typename Kernel>
+std::vector<quint16> ColorIndex::scan(const Kernel& kernel) const
+{
+    QMutexLocker locker(&mutex);
+    std::vector<quint16> result(rowCount);
+    const int total = rowCount;
+    cv::parallel_for_(cv::Range(0, total),
+                      [&](const cv::Range& range)
+                      {
+                          for (int i = range.start; i < range.end; i++)
+                              result[i] = kernel(segments[i / rowsPerSegment] + histogramColumnOffset + (i % rowsPerSegment) * binCount);
+                      },
+                      std::max(1.0, total / 65536.0));
+    return result;
+}
+
+std::vector<quint16> ColorIndex::distances(const Histogram& query) const
+{
+    return scan(DistanceKernel(query));
+}
+
+std::vector<quint16> ColorIndex::mass(const Histogram& mask) const
+{
+    return scan(MassKernel(mask));
+}
+
+std::vector<uchar> ColorIndex::clippedShares() const
+{
+    QMutexLocker locker(&mutex);
+    std::vector<uchar> result(rowCount);
+    for (int s = 0; s * rowsPerSegment < rowCount; s++)
+        std::memcpy(result.data() + s * rowsPerSegment, segments[s] + clippedColumn, std::min(rowsPerSegment, rowCount - s * rowsPerSegment));
+    return result;
+}
+
+quint64 ColorIndex::hashName(const QByteArray& name)
+{
+    // FNV-1a: stable across runs, unlike qHash.
+    quint64 hash = 14695981039346656037ULL;
+    for (char c : name)
+    {
+        hash ^= static_cast<uchar>(c);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+bool ColorIndex::addSegment()
+{
+    qint64 offset = headerBytes + static_cast<qint64>(segments.size()) * segmentBytes;
+    if (!file.resize(offset + segmentBytes))
+        return false;
+    uchar* segment = file.map(offset, segmentBytes);
+    if (!segment)
+        return false;
+    segments.push_back(segment);
+    return true;
+}
+
+ColorIndexer::ColorIndexer(QObject* parent) : QObject(parent), canceled(false), running(false)
+{
+}
+
+ColorIndexer::~ColorIndexer()
+{
+    cancel();
+}
+
+void ColorIndexer::start(const ImageList& list, const std::shared_ptr<ColorIndex>& index)
+{
+    cancel();
+    canceled = false;
+    running = true;
+    worker = std::thread(&ColorIndexer::run, this, list, index);
+}
+
+void ColorIndexer::cancel()
+{
+    canceled = true;
+    if (worker.joinable())
+        worker.join();
+    running = false;
+}
+
+void ColorIndexer::run(ImageList list, std::shared_ptr<ColorIndex> index)
+{
+    const int total = list.size();
+    std::atomic<int> done(0);
+    std::atomic<int> indexed(0);
+    emit progress(0, total);
+    // Decoding dominates, so files are spread over every core in small
+    // stripes; the stat that skips unchanged files is spread along with it.
+    cv::parallel_for_(cv::Range(0, total),
+                      [&](const cv::Range& range)
+                      {
+                          for (int i = range.start; i < range.end && !canceled.load(); i++)
+                          {
+                              const QByteArray name(list.name(i));
+                              const QString path = list.path(i);
+                              ColorIndex::Entry entry;
+                              if (!index->isCurrent(name, path) && ColorIndex::compute(path, entry) && index->store(name, entry))
+                                  indexed++;
+                              int n = ++done;
+                              if (n % 64 == 0)
+                                  emit progress(n, total);
+                          }
+                      },
+                      std::max(1.0, total / 16.0));
+    const bool completed = !canceled.load();
+    if (completed)
+        emit progress(total, total);
+    qDebug() << "Color index:" << indexed.load() << "of" << total << "images (re)indexed," << index->count() << "total";
+    running = false;
+    emit finished(completed);
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef COLOR_INDEX_H
+#define COLOR_INDEX_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include <thread>
+#include <vector>
+
+#include "image_list.h"
+
+// Compact HSV histograms of one directory's images in a memory-mapped file
+// under the cache location. Rows are appended in segments, and each segment
+// is stored column by column (name hashes, histograms, clipped shares), so a
+// query streams one contiguous column. Like the thumbnail atlas, rows are
+// written once, a later row for the same name supersedes an earlier one, and
+// each row records the file's modification time and size so a file changed
+// in place is indexed again.
+class ColorIndex
+{
+public:
+    // 8 hue x 4 saturation x 2 value bins; each holds its share of the
+    // image's pixels in 1/255 units.
+    static const int hueBins = 8;
+    static const int satBins = 4;
+    static const int valBins = 2;
+    static const int binCount = hueBins * satBins * valBins;
+    using Histogram = std::array<uchar, binCount>;
+
+    struct Entry
+    {
+        Histogram histogram;
+        // Share of pixels at or near full value, in 1/255 units.
+        uchar clipped;
+        // Of the file the histogram was computed from, taken before decoding.
+        qint64 modified = -1;
+        qint64 size = -1;
+    };
+
+    ColorIndex();
+    ~ColorIndex();
+
+    static QString indexPath(const QString& directory);
+    static int bin(int hueBin, int satBin, int valBin) { return (hueBin * satBins + satBin) * valBins + valBin; }
+    // Reduced decode, converted by the HSV plugin's kernel and binned.
+    static bool compute(const QString& path, Entry& entry);
+
+    bool open(const QString& directory);
+    void close();
+    bool isOpen() const;
+
+    // Whether the row for name was computed from the file as it is now.
+    bool isCurrent(const QByteArray& name, const QString& path) const;
+    bool lookup(const QByteArray& name, Entry& entry) const;
+    bool store(const QByteArray& name, const Entry& entry);
+    int count() const;
+
+    // Row of every list entry, or -1 where it is not indexed.
+    std::vector<int> rowsFor(const ImageList& list) const;
+    // L1 distance of every row's histogram to query, 0 to 510.
+    std::vector<quint16> distances(const Histogram& query) const;
+    // Share of every row's pixels in the bins where mask is 0xff, 0 to 255.
+    std::vector<quint16> mass(const Histogram& mask) const;
+    std::vector<uchar> clippedShares() const;
+
+private:
+    static quint64 hashName(const QByteArray& name);
+    bool addSegment();
+    const uchar* histogramColumn(int segment) const;
+    template <typename Kernel>
+    std::vector<quint16> scan(const Kernel& kernel) const;
+
+    QFile file;
+    uchar* header;
+    std::vector<uchar*> segments;
+    QHash<quint64, int> rows;
+    int rowCount;
+    mutable QMutex mutex;
+};
+
+// Indexes the images of a list that are missing from a ColorIndex on a
+// background thread, spreading the decodes over all cores.
+class ColorIndexer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ColorIndexer(QObject* parent = nullptr);
+    ~ColorIndexer();
+
+    // Cancels any running job first.
+    void start(const ImageList& list, const std::shared_ptr<ColorIndex>& index);
+    void cancel();
+    bool isRunning() const { return running.load(); }
+
+signals:
+    void progress(int done, int total);
+    // completed is false if the job was canceled.
+    void finished(bool completed);
+
+private:
+    void run(ImageList list, std::shared_ptr<ColorIndex> index);
+
+    std::thread worker;
+    std::atomic<bool> canceled;
+    std::atomic<bool> running;
+};
+
+#endif // COLOR_INDEX_H
@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "directory_scanner.h"
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QSocketNotifier>
+#include <cerrno>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <dirent.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const int batchSize = 2048;
+    const qint64 batchIntervalMs = 100;
+} // namespace
+
+DirectoryScanner::DirectoryScanner(QObject* parent) : QObject(parent), canceled(false), currentScanId(0), watchFd(-1), watchDescriptor(-1), notifier(nullptr)
+{
+#ifdef Q_OS_LINUX
+    watchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watchFd < 0)
+    {
+        qWarning() << "inotify unavailable, new files will not be picked up:" << std::strerror(errno);
+        return;
+    }
+    notifier = new QSocketNotifier(watchFd, QSocketNotifier::Read, this);
+    connect(notifier, &QSocketNotifier::activated, this, &DirectoryScanner::readWatchEvents);
+#endif
+}
+
+DirectoryScanner::~DirectoryScanner()
+{
+    stop();
+#ifdef Q_OS_LINUX
+    if (watchFd >= 0)
+        close(watchFd);
+#endif
+}
+
+bool DirectoryScanner::isImageName(const char* name)
+{
+    const char* dot = std::strrchr(name, '.');
+    if (!dot || dot == name)
+        return false;
+    dot++;
+    return qstricmp(dot, "png") == 0 || qstricmp(dot, "jpg") == 0 || qstricmp(dot, "jpeg") == 0 || qstricmp(dot, "bmp") == 0 || qstricmp(dot, "tif") == 0 ||
+           qstricmp(dot, "tiff") == 0 || qstricmp(dot, "exr") == 0;
+}
+
+quint64 DirectoryScanner::start(const QString& directory)
+{
+    stop();
+    quint64 scanId = ++currentScanId;
+    QByteArray dir = QFile::encodeName(QDir(directory).absolutePath());
+    // Watch before enumerating so files written during the scan are not missed;
+    // the receiver drops names it already has.
+    watch(dir);
+    canceled = false;
+    worker = std::thread(&DirectoryScanner::scan, this, scanId, dir);
+    return scanId;
+}
+
+void DirectoryScanner::stop()
+{
+    canceled = true;
+    if (worker.joinable())
+        worker.join();
+}
+
+void DirectoryScanner::scan(quint64 scanId, const QByteArray& directory)
+{
+    QList<QByteArray> batch;
+    QElapsedTimer sinceEmit;
+    sinceEmit.start();
+    bool firstFound = false;
+    auto found = [&](const char* name)
+    {
+        batch.append(QByteArray(name));
+        // The first hit goes out alone so the viewer can show it right away.
+        if (!firstFound || batch.size() >= batchSize || sinceEmit.elapsed() >= batchIntervalMs)
+        {
+            firstFound = true;
+            emit batchFound(scanId, batch);
+            batch.clear();
+            sinceEmit.restart();
+        }
+    };
+
+#ifdef Q_OS_UNIX
+    // readdir with d_type avoids a stat per entry, which is what makes
+    // QDir::entryList slow on network mounts.
+    DIR* dir = opendir(directory.constData());
+    if (!dir)
+    {
+        qWarning() << "Failed to open directory" << directory << std::strerror(errno);
+    }
+    else
+    {
+        while (!canceled)
+        {
+            struct dirent* entry = readdir(dir);
+            if (!entry)
+                break;
+            if (entry->d_type != DT_REG && entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN)
+                continue;
+            if (isImageName(entry->d_name))
+                found(entry->d_name);
+        }
+        closedir(dir);
+    }
+#else
+    QDirIterator it(QFile::decodeName(directory), QDir::Files);
+    while (!canceled && it.hasNext())
+    {
+        it.next();
+        QByteArray name = it.fileName().toUtf8();
+        if (isImageName(name.constData()))
+            found(name.constData());
+    }
+#endif
+
+    if (canceled)
+        return;
+    if (!batch.isEmpty())
+        emit batchFound(scanId, batch);
+    emit finished(scanId);
+}
+
+void DirectoryScanner::watch(const QByteArray& directory)
+{
+#ifdef Q_OS_LINUX
+    if (watchFd < 0)
+        return;
+    if (watchDescriptor >= 0)
+        inotify_rm_watch(watchFd, watchDescriptor);
+    // Only completed files: IN_CREATE would report captures still being written.
+    watchDescriptor = inotify_add_watch(watchFd, directory.constData(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (watchDescriptor < 0)
+        qWarning() << "Failed to watch" << directory << std::strerror(errno);
+#else
+    Q_UNUSED(directory);
+#endif
+}
+
+void DirectoryScanner::readWatchEvents()
+{
+#ifdef Q_OS_LINUX
+    alignas(struct inotify_event) char buffer[16384];
+    QList<QByteArray> names;
+    for (;;)
+    {
+        ssize_t len = read(watchFd, buffer, sizeof(buffer));
+        if (len <= 0)
+            break;
+        for (char* p = buffer; p < buffer + len;)
+        {
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(p);
+            p += sizeof(struct inotify_event) + event->len;
+            // Events for a watch removed by a restart may still be queued.
+            if (event->wd != watchDescriptor || event->len == 0 || (event->mask & IN_ISDIR))
+                continue;
+            if (isImageName(event->name))
+                names.append(QByteArray(event->name));
+        }
+    }
+    if (!names.isEmpty())
+        emit filesAdded(names);
+#endif
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef DIRECTORY_SCANNER_H
+#define DIRECTORY_SCANNER_H
+
+#include <QByteArray>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <atomic>
+#include <thread>
+
+class QSocketNotifier;
+
+// Enumerates image files of a directory on a background thread and reports
+// them in batches as they are found, so the first image can be shown before
+// a large directory has been read. On Linux the directory is also watched
+// with inotify and files that appear later are reported without a rescan.
+class DirectoryScanner : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DirectoryScanner(QObject* parent = nullptr);
+    ~DirectoryScanner();
+
+    static bool isImageName(const char* name);
+
+    // Cancels any running scan; returns the id carried by this scan's signals.
+    quint64 start(const QString& directory);
+    void stop();
+
+signals:
+    // File names relative to the scanned directory, in directory order.
+    void batchFound(quint64 scanId, const QList<QByteArray>& names);
+    void finished(quint64 scanId);
+    void filesAdded(const QList<QByteArray>& names);
+
+private:
+    void scan(quint64 scanId, const QByteArray& directory);
+    void watch(const QByteArray& directory);
+    void readWatchEvents();
+
+    std::thread worker;
+    std::atomic<bool> canceled;
+    quint64 currentScanId;
+    int watchFd;
+    int watchDescriptor;
+    QSocketNotifier* notifier;
+};
+
+#endif // DIRECTORY_SCANNER_H
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "exif_thumbnail.h"
+#include <QFile>
+#include <cstring>
+
+namespace
+{
+    // APP1 is limited to 64 KiB and comes before the image data.
+    const qint64 maxHeaderBytes = 128 * 1024;
+
+    class TiffReader
+    {
+    public:
+        TiffReader(const uchar* data, int size) : data(data), size(size), bigEndian(false) {}
+
+        bool init()
+        {
+            if (size < 8)
+                return false;
+            if (data[0] == 'I' && data[1] == 'I')
+                bigEndian = false;
+            else if (data[0] == 'M' && data[1] == 'M')
+                bigEndian = true;
+            else
+                return false;
+            return u16(2) == 42;
+        }
+        bool contains(quint32 offset, quint32 bytes) const { return offset <= static_cast<quint32>(size) && bytes <= static_cast<quint32>(size) - offset; }
+        quint16 u16(quint32 offset) const
+        {
+            if (!contains(offset, 2))
+                return 0;
+            return bigEndian ? static_cast<quint16>(data[offset] << 8 | data[offset + 1]) : static_cast<quint16>(data[offset + 1] << 8 | data[offset]);
+        }
+        quint32 u32(quint32 offset) const
+        {
+            if (!contains(offset, 4))
+                return 0;
+            if (bigEndian)
+                return static_cast<quint32>(data[offset]) << 24 | static_cast<quint32>(data[offset + 1]) << 16 | static_cast<quint32>(data[offset + 2]) << 8 | data[offset + 3];
+            return static_cast<quint32>(data[offset + 3]) << 24 | static_cast<quint32>(data[offset + 2]) << 16 | static_cast<quint32>(data[offset + 1]) << 8 | data[offset];
+        }
+        // Value of a SHORT or LONG entry, which is stored inline.
+        quint32 value(quint32 entry) const { return u16(entry + 2) == 3 ? u16(entry + 8) : u32(entry + 8); }
+
+        const uchar* data;
+        int size;
+        bool bigEndian;
+    };
+} // namespace
+
+bool readExifThumbnail(const QString& path, ExifThumbnail& thumbnail)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    QByteArray head = file.read(maxHeaderBytes);
+    const uchar* p = reinterpret_cast<const uchar*>(head.constData());
+    const int size = head.size();
+    if (size < 4 || p[0] != 0xFF || p[1] != 0xD8)
+        return false;
+
+    int pos = 2;
+    while (pos + 4 <= size && p[pos] == 0xFF)
+    {
+        const uchar marker = p[pos + 1];
+        const int length = p[pos + 2] << 8 | p[pos + 3];
+        // Start of scan: no metadata follows.
+        if (marker == 0xDA || length < 2)
+            return false;
+        const int segment = pos + 4;
+        if (marker == 0xE1 && length >= 8 && segment + 6 <= size && std::memcmp(p + segment, "Exif\0\0", 6) == 0)
+        {
+            TiffReader tiff(p + segment + 6, qMin(length - 8, size - segment - 6));
+            if (!tiff.init())
+                return false;
+
+            quint32 ifd0 = tiff.u32(4);
+            quint16 count0 = tiff.u16(ifd0);
+            if (!tiff.contains(ifd0 + 2, count0 * 12u + 4))
+                return false;
+            for (quint16 i = 0; i < count0; i++)
+            {
+                quint32 entry = ifd0 + 2 + i * 12u;
+                if (tiff.u16(entry) == 0x0112)
+                    thumbnail.orientation = qBound(1, static_cast<int>(tiff.value(entry)), 8);
+            }
+
+            quint32 ifd1 = tiff.u32(ifd0 + 2 + count0 * 12u);
+            quint16 count1 = ifd1 ? tiff.u16(ifd1) : 0;
+            quint32 offset = 0;
+            quint32 bytes = 0;
+            if (count1 && tiff.contains(ifd1 + 2, count1 * 12u))
+            {
+                for (quint16 i = 0; i < count1; i++)
+                {
+                    quint32 entry = ifd1 + 2 + i * 12u;
+                    if (tiff.u16(entry) == 0x0201)
+                        offset = tiff.value(entry);
+                    else if (tiff.u16(entry) == 0x0202)
+                        bytes = tiff.value(entry);
+                }
+            }
+            if (!offset || !bytes || !tiff.contains(offset, bytes))
+                return false;
+            thumbnail.jpeg = QByteArray(reinterpret_cast<const char*>(tiff.data + offset), static_cast<int>(bytes));
+            return true;
+        }
+        pos += 2 + length;
+    }
+    return false;
+}
+
+void applyExifOrientation(cv::Mat& image, int orientation)
+{
+    switch (orientation)
+    {
+    case 2:
+        cv::flip(image, image, 1);
+        break;
+    case 3:
+        cv::rotate(image, image, cv::ROTATE_180);
+        break;
+    case 4:
+        cv::flip(image, image, 0);
+        break;
+    case 5:
+        cv::transpose(image, image);
+        break;
+    case 6:
+        cv::rotate(image, image, cv::ROTATE_90_CLOCKWISE);
+        break;
+    case 7:
+        cv::transpose(image, image);
+        cv::flip(image, image, -1);
+        break;
+    case 8:
+        cv::rotate(image, image, cv::ROTATE_90_COUNTERCLOCKWISE);
+        break;
+    default:
+        break;
+    }
+}
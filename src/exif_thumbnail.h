@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef EXIF_THUMBNAIL_H
+#define EXIF_THUMBNAIL_H
+
+#include <QByteArray>
+#include <QString>
+#include <opencv2/opencv.hpp>
+
+struct ExifThumbnail
+{
+    QByteArray jpeg;
+    // EXIF orientation of the main image, 1..8.
+    int orientation = 1;
+};
+
+// Extracts the JPEG thumbnail from a JPEG file's EXIF block, reading only the
+// start of the file. Returns false if there is none.
+bool readExifThumbnail(const QString& path, ExifThumbnail& thumbnail);
+
+// Rotates/flips an image the way cv::imread does for the given EXIF orientation.
+void applyExifOrientation(cv::Mat& image, int orientation);
+
+#endif // EXIF_THUMBNAIL_H
@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "frame_pipeline.h"
+#include "trace.h"
+#include <QDebug>
+#include <chrono>
+
+namespace
+{
+    const size_t decodedCapacity = 4;
+    const size_t renderedCapacity = 2;
+    const qint64 statsWindowNs = 1000000000LL;
+} // namespace
+
+FramePipeline::FramePipeline(AIPluginManager* manager, QObject* parent)
+    : QObject(parent), manager(manager), realtime(true), running(false), notified(false), decodedCount(0), displayedCount(0)
+{
+}
+
+FramePipeline::~FramePipeline()
+{
+    stop();
+}
+
+void FramePipeline::start(std::unique_ptr<FrameSource> frameSource, const std::vector<int>& modelIndices, DropPolicy policy, bool realtimePlayback)
+{
+    stop();
+    if (!frameSource)
+        return;
+    source = std::move(frameSource);
+    chain = modelIndices;
+    realtime = realtimePlayback;
+    decoded.reset(new RingBuffer<Frame>(decodedCapacity, policy));
+    // Display only ever wants the newest frame, so this stage never blocks.
+    rendered.reset(new RingBuffer<Frame>(renderedCapacity, DropPolicy::DropOldest));
+    decodedCount = 0;
+    notified = false;
+    {
+        QMutexLocker locker(&statsMutex);
+        recent.clear();
+        displayedCount = 0;
+    }
+    cancelToken = std::make_shared<AICancelToken>();
+    running = true;
+    qDebug() << "Playing" << source->description() << "at" << source->frameRate() << "fps";
+    decoder = std::thread(&FramePipeline::decodeLoop, this);
+    renderer = std::thread(&FramePipeline::renderLoop, this);
+}
+
+void FramePipeline::stop()
+{
+    running = false;
+    if (cancelToken)
+        cancelToken->cancel();
+    if (decoded)
+        decoded->close();
+    if (rendered)
+        rendered->close();
+    if (decoder.joinable())
+        decoder.join();
+    if (renderer.joinable())
+        renderer.join();
+    source.reset();
+}
+
+void FramePipeline::decodeLoop()
+{
+    const double fps = source->frameRate();
+    const auto begin = std::chrono::steady_clock::now();
+    qint64 n = 0;
+    while (running)
+    {
+        if (realtime && fps > 0.0)
+        {
+            // Pace against the start time, not the previous frame, so a slow
+            // decode is caught up instead of accumulating drift.
+            auto due = begin + std::chrono::nanoseconds(static_cast<qint64>(n * 1e9 / fps));
+            std::this_thread::sleep_until(due);
+        }
+        Frame frame;
+        if (!source->read(frame))
+            break;
+        n++;
+        decodedCount++;
+        if (!decoded->push(std::move(frame)))
+            return;
+    }
+    decoded->close();
+}
+
+void FramePipeline::renderLoop()
+{
+    const std::shared_ptr<AICancelToken> token = cancelToken;
+    cv::Mat buffers[2];
+    Frame frame;
+    while (decoded->pop(frame))
+    {
+        if (!chain.empty())
+            frame.image = manager->renderChain(frame.image, chain, token.get(), buffers);
+        if (frame.image.empty())
+            continue;
+        if (!rendered->push(std::move(frame)))
+            return;
+        if (!notified.exchange(true))
+            emit frameAvailable();
+    }
+    rendered->close();
+    if (running)
+    {
+        running = false;
+        emit finished();
+    }
+}
+
+bool FramePipeline::takeFrame(Frame& frame)
+{
+    notified = false;
+    if (!rendered || !rendered->popLatest(frame))
+        return false;
+    qint64 now = Trace::nowNs();
+    QMutexLocker locker(&statsMutex);
+    displayedCount++;
+    recent.emplace_back(now, now - frame.decodeStartNs);
+    while (!recent.empty() && now - recent.front().first > statsWindowNs)
+        recent.pop_front();
+    return true;
+}
+
+FramePipeline::Stats FramePipeline::stats() const
+{
+    Stats s;
+    s.decoded = decodedCount;
+    {
+        QMutexLocker locker(&statsMutex);
+        s.displayed = displayedCount;
+        if (recent.size() > 1)
+        {
+            qint64 sum = 0;
+            qint64 worst = 0;
+            for (const auto& r : recent)
+            {
+                sum += r.second;
+                worst = qMax(worst, r.second);
+            }
+            s.fps = (recent.size() - 1) * 1e9 / (recent.back().first - recent.front().first);
+            s.meanLatencyMs = sum / 1e6 / recent.size();
+            s.maxLatencyMs = worst / 1e6;
+        }
+    }
+    if (decoded)
+        s.dropped += decoded->droppedCount();
+    if (rendered)
+        s.dropped += rendered->droppedCount();
+    return s;
+}
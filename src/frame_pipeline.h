@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef FRAME_PIPELINE_H
+#define FRAME_PIPELINE_H
+
+#include <QMutex>
+#include <QObject>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "ai_plugin_manager.h"
+#include "frame_source.h"
+#include "ring_buffer.h"
+
+// Plays a FrameSource through the plugin chain as overlapping stages:
+// a decode thread paced to the source's frame rate, a plugin thread, and the
+// display, which pulls the newest rendered frame whenever frameAvailable
+// fires. The drop policy decides what happens between decode and plugins
+// when the chain cannot keep up; the display always shows the newest frame.
+class FramePipeline : public QObject
+{
+    Q_OBJECT
+public:
+    struct Stats
+    {
+        double fps = 0.0;
+        double meanLatencyMs = 0.0;
+        double maxLatencyMs = 0.0;
+        quint64 decoded = 0;
+        quint64 displayed = 0;
+        quint64 dropped = 0;
+    };
+
+    explicit FramePipeline(AIPluginManager* manager, QObject* parent = nullptr);
+    ~FramePipeline();
+
+    // realtime paces decoding to the source's frame rate; otherwise frames
+    // are decoded as fast as the downstream stages accept them.
+    void start(std::unique_ptr<FrameSource> source, const std::vector<int>& modelIndices, DropPolicy policy, bool realtime = true);
+    void stop();
+    bool isRunning() const { return running; }
+
+    // Called by the display stage: the newest rendered frame, if any.
+    bool takeFrame(Frame& frame);
+    // Over the last second of displayed frames.
+    Stats stats() const;
+
+signals:
+    // Coalesced: fires once until takeFrame has been called.
+    void frameAvailable();
+    void finished();
+
+private:
+    void decodeLoop();
+    void renderLoop();
+
+    AIPluginManager* manager;
+    std::unique_ptr<FrameSource> source;
+    std::vector<int> chain;
+    bool realtime;
+    std::unique_ptr<RingBuffer<Frame>> decoded;
+    std::unique_ptr<RingBuffer<Frame>> rendered;
+    std::thread decoder;
+    std::thread renderer;
+    // One per run; stop() cancels it so a slow stage returns before the join.
+    std::shared_ptr<AICancelToken> cancelToken;
+    std::atomic<bool> running;
+    std::atomic<bool> notified;
+    std::atomic<quint64> decodedCount;
+
+    mutable QMutex statsMutex;
+    // (display time, latency) of recent frames, in ns.
+    std::deque<std::pair<qint64, qint64>> recent;
+    quint64 displayedCount;
+};
+
+#endif // FRAME_PIPELINE_H
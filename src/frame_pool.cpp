@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "frame_pool.h"
+#include <QDebug>
+
+FramePool::FramePool() : hits(0), misses(0), bytesHeld(0), bytesInUse(0), highWater(0) {}
+
+FramePool* FramePool::instance()
+{
+    // Never destroyed: Mats released during static destruction still call back
+    // into their allocator.
+    static FramePool* pool = new FramePool();
+    return pool;
+}
+
+void FramePool::install(qint64 highWaterBytes)
+{
+    FramePool* pool = instance();
+    pool->setHighWaterMark(highWaterBytes);
+    cv::Mat::setDefaultAllocator(highWaterBytes > 0 ? pool : nullptr);
+    qDebug() << "Frame pool high-water mark:" << highWaterBytes / (1024 * 1024) << "MB";
+}
+
+void FramePool::setHighWaterMark(qint64 bytes)
+{
+    QMutexLocker locker(&mutex);
+    highWater = bytes;
+    evict(highWater, 0);
+}
+
+void FramePool::trim()
+{
+    QMutexLocker locker(&mutex);
+    evict(0, 0);
+}
+
+FramePool::Stats FramePool::stats() const
+{
+    QMutexLocker locker(&mutex);
+    Stats s;
+    s.hits = hits;
+    s.misses = misses;
+    s.bytesHeld = bytesHeld;
+    s.bytesInUse = bytesInUse;
+    return s;
+}
+
+size_t FramePool::sizeClass(size_t bytes)
+{
+    if (bytes < minPooledBytes)
+        return bytes;
+    size_t power = minPooledBytes;
+    while (power * 2 <= bytes)
+        power *= 2;
+    // At most 12.5% over the request; untouched tail pages are never faulted in.
+    const size_t step = power / 8;
+    return (bytes + step - 1) / step * step;
+}
+
+uchar* FramePool::acquire(size_t bytes) const
+{
+    const size_t capacity = sizeClass(bytes);
+    if (capacity < minPooledBytes)
+        return static_cast<uchar*>(cv::fastMalloc(capacity));
+    {
+        QMutexLocker locker(&mutex);
+        bytesInUse += static_cast<qint64>(capacity);
+        auto it = freeLists.find(capacity);
+        if (it != freeLists.end() && !it->second.empty())
+        {
+            uchar* data = it->second.back();
+            it->second.pop_back();
+            bytesHeld -= static_cast<qint64>(capacity);
+            hits++;
+            return data;
+        }
+        misses++;
+    }
+    return static_cast<uchar*>(cv::fastMalloc(capacity));
+}
+
+void FramePool::recycle(uchar* data, size_t bytes) const
+{
+    const size_t capacity = sizeClass(bytes);
+    if (capacity < minPooledBytes)
+    {
+        cv::fastFree(data);
+        return;
+    }
+    {
+        QMutexLocker locker(&mutex);
+        bytesInUse -= static_cast<qint64>(capacity);
+        if (static_cast<qint64>(capacity) <= highWater)
+        {
+            // Make room by dropping other sizes first: after a resolution
+            // change the old classes are unlikely to be asked for again.
+            evict(highWater - static_cast<qint64>(capacity), capacity);
+            if (bytesHeld + static_cast<qint64>(capacity) <= highWater)
+            {
+                freeLists[capacity].push_back(data);
+                bytesHeld += static_cast<qint64>(capacity);
+                return;
+            }
+        }
+    }
+    cv::fastFree(data);
+}
+
+void FramePool::evict(qint64 targetBytes, size_t keepClass) const
+{
+    // Largest classes first, so the fewest buffers are freed.
+    for (auto it = freeLists.rbegin(); it != freeLists.rend() && bytesHeld > targetBytes; ++it)
+    {
+        if (it->first == keepClass)
+            continue;
+        while (!it->second.empty() && bytesHeld > targetBytes)
+        {
+            cv::fastFree(it->second.back());
+            it->second.pop_back();
+            bytesHeld -= static_cast<qint64>(it->first);
+        }
+    }
+}
+
+cv::UMatData* FramePool::allocate(int dims, const int* sizes, int type, void* data0, size_t* step, cv::AccessFlag, cv::UMatUsageFlags) const
+{
+    // Same layout rules as OpenCV's standard allocator.
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; i--)
+    {
+        if (step)
+        {
+            if (data0 && step[i] != CV_AUTOSTEP)
+            {
+                CV_Assert(total <= step[i]);
+                total = step[i];
+            }
+            else
+            {
+                step[i] = total;
+            }
+        }
+        total *= sizes[i];
+    }
+    cv::UMatData* u = new cv::UMatData(this);
+    u->data = u->origdata = data0 ? static_cast<uchar*>(data0) : acquire(total);
+    u->size = total;
+    if (data0)
+        u->flags |= cv::UMatData::USER_ALLOCATED;
+    return u;
+}
+
+bool FramePool::allocate(cv::UMatData* u, cv::AccessFlag, cv::UMatUsageFlags) const
+{
+    return u != nullptr;
+}
+
+void FramePool::deallocate(cv::UMatData* u) const
+{
+    if (!u)
+        return;
+    CV_Assert(u->urefcount == 0);
+    CV_Assert(u->refcount == 0);
+    if (!(u->flags & cv::UMatData::USER_ALLOCATED))
+        recycle(u->origdata, u->size);
+    delete u;
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <QMutex>
+#include <map>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Process-wide pool for large cv::Mat buffers. Once installed as OpenCV's
+// default allocator it serves every Mat created afterwards, including those
+// allocated by imread, cvtColor and plugins loaded into the process. Sizes
+// are rounded up to eighths of a power of two so frames of similar size share
+// a class; buffers below minPooledBytes bypass the pool.
+class FramePool : public cv::MatAllocator
+{
+public:
+    struct Stats
+    {
+        quint64 hits;
+        quint64 misses;
+        // Idle buffers kept for reuse, and pooled buffers currently in Mats.
+        qint64 bytesHeld;
+        qint64 bytesInUse;
+    };
+
+    static const size_t minPooledBytes = 256 * 1024;
+
+    static FramePool* instance();
+    // Makes the pool OpenCV's default allocator. A high-water mark of zero
+    // leaves the standard allocator in place.
+    static void install(qint64 highWaterBytes);
+
+    // Idle buffers beyond this many bytes are freed instead of kept.
+    void setHighWaterMark(qint64 bytes);
+    // Frees every idle buffer.
+    void trim();
+    Stats stats() const;
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override;
+    bool allocate(cv::UMatData* data, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override;
+    void deallocate(cv::UMatData* data) const override;
+
+private:
+    FramePool();
+
+    static size_t sizeClass(size_t bytes);
+    uchar* acquire(size_t bytes) const;
+    void recycle(uchar* data, size_t bytes) const;
+    void evict(qint64 targetBytes, size_t keepClass) const;
+
+    mutable QMutex mutex;
+    mutable std::map<size_t, std::vector<uchar*>> freeLists;
+    mutable quint64 hits;
+    mutable quint64 misses;
+    mutable qint64 bytesHeld;
+    mutable qint64 bytesInUse;
+    qint64 highWater;
+};
+
+#endif // FRAME_POOL_H
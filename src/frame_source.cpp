@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "frame_source.h"
+#include "directory_scanner.h"
+#include "image_cache.h"
+#include "tone_map.h"
+#include "trace.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QRegularExpression>
+
+std::unique_ptr<FrameSource> FrameSource::open(const QString& path, double sequenceFps)
+{
+    QString prefix;
+    QString suffix;
+    int number;
+    int digits;
+    bool isImage = DirectoryScanner::isImageName(QFile::encodeName(QFileInfo(path).fileName()).constData());
+    if (isImage && SequenceFrameSource::parse(path, prefix, number, digits, suffix))
+        return std::unique_ptr<FrameSource>(new SequenceFrameSource(prefix, number, digits, suffix, sequenceFps));
+    if (isImage)
+        return nullptr;
+    std::unique_ptr<VideoFrameSource> video(new VideoFrameSource(path));
+    if (!video->isOpened())
+        return nullptr;
+    return std::move(video);
+}
+
+VideoFrameSource::VideoFrameSource(const QString& path) : path(path), capture(path.toStdString()), fps(0.0), count(-1), next(0)
+{
+    if (!capture.isOpened())
+        return;
+    fps = capture.get(cv::CAP_PROP_FPS);
+    if (!(fps > 0.0 && fps < 1000.0))
+        fps = 30.0;
+    double frames = capture.get(cv::CAP_PROP_FRAME_COUNT);
+    count = frames > 0 ? static_cast<qint64>(frames) : -1;
+}
+
+bool VideoFrameSource::read(Frame& frame)
+{
+    frame.decodeStartNs = Trace::nowNs();
+    {
+        TRACE_SCOPE("decode");
+        if (!capture.read(frame.image) || frame.image.empty())
+            return false;
+    }
+    frame.index = next++;
+    double position = capture.get(cv::CAP_PROP_POS_MSEC);
+    frame.timestampMs = position > 0.0 ? position : frame.index * 1000.0 / fps;
+    return true;
+}
+
+SequenceFrameSource::SequenceFrameSource(const QString& prefix, int firstNumber, int digits, const QString& suffix, double fps)
+    : prefix(prefix), number(firstNumber), digits(digits), suffix(suffix), fps(fps > 0.0 ? fps : 30.0), next(0)
+{
+}
+
+bool SequenceFrameSource::parse(const QString& path, QString& prefix, int& number, int& digits, QString& suffix)
+{
+    static const QRegularExpression pattern("^(.*?)(\\d+)(\\.[^./]+)$");
+    QRegularExpressionMatch match = pattern.match(path);
+    if (!match.hasMatch() || match.captured(2).size() > 9)
+        return false;
+    prefix = match.captured(1);
+    number = match.captured(2).toInt();
+    digits = match.captured(2).size();
+    suffix = match.captured(3);
+    return true;
+}
+
+QString SequenceFrameSource::description() const
+{
+    return prefix + QString("%0") + QString::number(digits) + "d" + suffix;
+}
+
+bool SequenceFrameSource::read(Frame& frame)
+{
+    QString path = prefix + QString("%1").arg(number + next, digits, 10, QChar('0')) + suffix;
+    frame.decodeStartNs = Trace::nowNs();
+    frame.image = toBgr8(ImageCache::decode(path));
+    if (frame.image.empty())
+        return false;
+    frame.index = next++;
+    frame.timestampMs = frame.index * 1000.0 / fps;
+    return true;
+}
+
+DirectoryFrameSource::DirectoryFrameSource(const ImageList& images, int startIndex, double fps) : images(images), next(qMax(0, startIndex)), fps(fps > 0.0 ? fps : 30.0) {}
+
+bool DirectoryFrameSource::read(Frame& frame)
+{
+    // Unreadable files are skipped rather than ending playback.
+    while (next < images.size())
+    {
+        int index = next++;
+        frame.decodeStartNs = Trace::nowNs();
+        frame.image = toBgr8(ImageCache::decode(images.path(index)));
+        if (frame.image.empty())
+            continue;
+        frame.index = index;
+        frame.timestampMs = index * 1000.0 / fps;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef FRAME_SOURCE_H
+#define FRAME_SOURCE_H
+
+#include <QString>
+#include <memory>
+#include <opencv2/opencv.hpp>
+
+#include "image_list.h"
+
+struct Frame
+{
+    qint64 index = -1;
+    // Position in the source's own timeline.
+    double timestampMs = 0.0;
+    // Trace::nowNs() when decoding of this frame started; used for latency.
+    qint64 decodeStartNs = 0;
+    cv::Mat image;
+};
+
+// A sequential source of frames. read() is only called from one thread.
+class FrameSource
+{
+public:
+    virtual ~FrameSource() {}
+    virtual bool read(Frame& frame) = 0;
+    // Nominal playback rate; 0 when the source has none.
+    virtual double frameRate() const = 0;
+    // -1 when unknown.
+    virtual qint64 frameCount() const = 0;
+    virtual QString description() const = 0;
+
+    // A video file, or a numbered image sequence when path is one of its
+    // frames (e.g. capture_00042.png). Returns nullptr if neither opens.
+    static std::unique_ptr<FrameSource> open(const QString& path, double sequenceFps = 30.0);
+};
+
+class VideoFrameSource : public FrameSource
+{
+public:
+    explicit VideoFrameSource(const QString& path);
+    bool isOpened() const { return capture.isOpened(); }
+    bool read(Frame& frame) override;
+    double frameRate() const override { return fps; }
+    qint64 frameCount() const override { return count; }
+    QString description() const override { return path; }
+
+private:
+    QString path;
+    cv::VideoCapture capture;
+    double fps;
+    qint64 count;
+    qint64 next;
+};
+
+// Files named <prefix><number><suffix> with consecutive numbers, ending at
+// the first missing one.
+class SequenceFrameSource : public FrameSource
+{
+public:
+    SequenceFrameSource(const QString& prefix, int firstNumber, int digits, const QString& suffix, double fps);
+    // Splits a path like dir/capture_00042.png; false if it carries no number.
+    static bool parse(const QString& path, QString& prefix, int& number, int& digits, QString& suffix);
+    bool read(Frame& frame) override;
+    double frameRate() const override { return fps; }
+    qint64 frameCount() const override { return -1; }
+    QString description() const override;
+
+private:
+    QString prefix;
+    int number;
+    int digits;
+    QString suffix;
+    double fps;
+    qint64 next;
+};
+
+// The viewer's current directory listing, played in order.
+class DirectoryFrameSource : public FrameSource
+{
+public:
+    DirectoryFrameSource(const ImageList& images, int startIndex, double fps);
+    bool read(Frame& frame) override;
+    double frameRate() const override { return fps; }
+    qint64 frameCount() const override { return images.size(); }
+    QString description() const override { return images.directory(); }
+
+private:
+    ImageList images;
+    int next;
+    double fps;
+};
+
+#endif // FRAME_SOURCE_H
@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "image_cache.h"
+#include "exif_thumbnail.h"
+#include "trace.h"
+#include <QDebug>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QtConcurrent>
+
+ImageCache::ImageCache(qint64 budgetBytes, int prefetchCount, QObject* parent) : QObject(parent), budgetBytes(budgetBytes), usedBytes(0), prefetchN(prefetchCount)
+{
+    qRegisterMetaType<cv::Mat>("cv::Mat");
+    pool.setMaxThreadCount(qBound(1, prefetchCount, QThread::idealThreadCount()));
+}
+
+ImageCache::~ImageCache()
+{
+    {
+        QMutexLocker locker(&mutex);
+        wanted.clear();
+    }
+    pool.waitForDone();
+}
+
+cv::Mat ImageCache::decode(const QString& path)
+{
+    TRACE_SCOPE("decode");
+    return readImage(path);
+}
+
+cv::Mat ImageCache::readImage(const QString& path)
+{
+    // Keeps 16-bit and float data; the viewer maps it for display.
+    return cv::imread(path.toStdString(), cv::IMREAD_ANYDEPTH | cv::IMREAD_ANYCOLOR);
+}
+
+cv::Mat ImageCache::decodePreview(const QString& path)
+{
+    TRACE_SCOPE("decode_preview");
+    // JPEG decodes at 1/4 scale in the DCT domain, which is far cheaper than a full decode.
+    return cv::imread(path.toStdString(), cv::IMREAD_REDUCED_COLOR_4);
+}
+
+bool ImageCache::hasReducedDecode(const QString& path)
+{
+    // By name, so the check costs no I/O on the navigation path.
+    const QString suffix = QFileInfo(path).suffix().toLower();
+    return suffix == "jpg" || suffix == "jpeg";
+}
+
+cv::Mat ImageCache::decodeQuick(const QString& path)
+{
+    TRACE_SCOPE("decode_quick");
+    // Only the header is read here. Other formats decode fully before
+    // downscaling, and small JPEGs decode fast enough that a stand-in would
+    // only flash before the full image resets the view.
+    QImageReader reader(path);
+    if (reader.format() != "jpeg")
+        return cv::Mat();
+    QSize size = reader.size();
+    double megapixels = size.width() * static_cast<double>(size.height()) / 1e6;
+    if (megapixels <= 1.5)
+        return cv::Mat();
+
+    ExifThumbnail thumbnail;
+    if (readExifThumbnail(path, thumbnail))
+    {
+        cv::Mat image = cv::imdecode(cv::Mat(1, thumbnail.jpeg.size(), CV_8UC1, thumbnail.jpeg.data()), cv::IMREAD_COLOR);
+        if (!image.empty())
+        {
+            applyExifOrientation(image, thumbnail.orientation);
+            return image;
+        }
+    }
+
+    int flags;
+    if (megapixels > 24.0)
+        flags = cv::IMREAD_REDUCED_COLOR_8;
+    else if (megapixels > 6.0)
+        flags = cv::IMREAD_REDUCED_COLOR_4;
+    else
+        flags = cv::IMREAD_REDUCED_COLOR_2;
+    return cv::imread(path.toStdString(), flags);
+}
+
+cv::Mat ImageCache::get(const QString& path)
+{
+    QMutexLocker locker(&mutex);
+    while (inFlight.contains(path))
+        decodedCondition.wait(&mutex);
+
+    auto it = entries.find(path);
+    if (it != entries.end())
+    {
+        lru.splice(lru.begin(), lru, it->lruIt);
+        return it->image;
+    }
+
+    inFlight.insert(path);
+    locker.unlock();
+    cv::Mat image = decode(path);
+    locker.relock();
+    inFlight.remove(path);
+    if (!image.empty())
+        insert(path, image);
+    decodedCondition.wakeAll();
+    return image;
+}
+
+cv::Mat ImageCache::peek(const QString& path)
+{
+    QMutexLocker locker(&mutex);
+    auto it = entries.find(path);
+    if (it == entries.end())
+        return cv::Mat();
+    lru.splice(lru.begin(), lru, it->lruIt);
+    return it->image;
+}
+
+void ImageCache::prefetch(const QStringList& paths)
+{
+    QMutexLocker locker(&mutex);
+    // Decodes still queued from an earlier call bail out in runPrefetch once
+    // their path is no longer wanted.
+    wanted.clear();
+    for (const QString& path : paths)
+    {
+        if (entries.contains(path) || inFlight.contains(path) || wanted.contains(path))
+            continue;
+        wanted.insert(path);
+        QtConcurrent::run(&pool, [this, path]() { runPrefetch(path); });
+    }
+}
+
+void ImageCache::clear()
+{
+    QMutexLocker locker(&mutex);
+    wanted.clear();
+    entries.clear();
+    lru.clear();
+    usedBytes = 0;
+}
+
+void ImageCache::setBudget(qint64 bytes)
+{
+    QMutexLocker locker(&mutex);
+    budgetBytes = bytes;
+    evict();
+}
+
+qint64 ImageCache::budget() const
+{
+    QMutexLocker locker(&mutex);
+    return budgetBytes;
+}
+
+qint64 ImageCache::usage() const
+{
+    QMutexLocker locker(&mutex);
+    return usedBytes;
+}
+
+void ImageCache::setPrefetchCount(int count)
+{
+    QMutexLocker locker(&mutex);
+    prefetchN = qMax(0, count);
+    pool.setMaxThreadCount(qBound(1, prefetchN, QThread::idealThreadCount()));
+}
+
+int ImageCache::prefetchCount() const
+{
+    QMutexLocker locker(&mutex);
+    return prefetchN;
+}
+
+void ImageCache::insert(const QString& path, const cv::Mat& image)
+{
+    qint64 bytes = static_cast<qint64>(image.total() * image.elemSize());
+    if (bytes > budgetBytes || entries.contains(path))
+        return;
+    lru.push_front(path);
+    Entry entry;
+    entry.image = image;
+    entry.bytes = bytes;
+    entry.lruIt = lru.begin();
+    entries.insert(path, entry);
+    usedBytes += bytes;
+    evict();
+}
+
+void ImageCache::evict()
+{
+    while (usedBytes > budgetBytes && !lru.empty())
+    {
+        auto it = entries.find(lru.back());
+        usedBytes -= it->bytes;
+        entries.erase(it);
+        lru.pop_back();
+    }
+}
+
+void ImageCache::runPrefetch(const QString& path)
+{
+    // Neighbours decode under their own span name, so they do not overwrite
+    // the current frame's "decode" entry in the overlay.
+    TRACE_SCOPE("prefetch");
+    QMutexLocker locker(&mutex);
+    if (!wanted.remove(path) || entries.contains(path) || inFlight.contains(path))
+        return;
+    inFlight.insert(path);
+    locker.unlock();
+
+    cv::Mat image = readImage(path);
+
+    locker.relock();
+    inFlight.remove(path);
+    if (!image.empty())
+        insert(path, image);
+    decodedCondition.wakeAll();
+    locker.unlock();
+
+    if (image.empty())
+        qDebug() << "Prefetch failed for" << path;
+    else
+        emit imageDecoded(path, image);
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef IMAGE_CACHE_H
+#define IMAGE_CACHE_H
+
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QWaitCondition>
+#include <list>
+#include <opencv2/opencv.hpp>
+
+// LRU cache of decoded images bounded by a byte budget. Images can be
+// prefetched on background workers so that navigation only hits the cache.
+class ImageCache : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ImageCache(qint64 budgetBytes = 512LL * 1024 * 1024, int prefetchCount = 2, QObject* parent = nullptr);
+    ~ImageCache();
+
+    // Keeps the file's depth and channel count (1 or 3); see toBgr8.
+    static cv::Mat decode(const QString& path);
+    static cv::Mat decodePreview(const QString& path);
+    // Whether decodePreview is much cheaper than decode; only JPEG scales in
+    // the DCT domain, other formats decode fully and then resize.
+    static bool hasReducedDecode(const QString& path);
+    // Fastest useful stand-in for the full decode: the embedded EXIF thumbnail,
+    // or a DCT-scaled decode sized to the image. Empty when the full decode
+    // would not be much slower.
+    static cv::Mat decodeQuick(const QString& path);
+
+    cv::Mat get(const QString& path);
+    cv::Mat peek(const QString& path);
+    void prefetch(const QStringList& paths);
+    void clear();
+
+    void setBudget(qint64 bytes);
+    qint64 budget() const;
+    qint64 usage() const;
+    void setPrefetchCount(int count);
+    int prefetchCount() const;
+
+signals:
+    // Carries the image, since one over the budget is not kept in the cache.
+    void imageDecoded(const QString& path, const cv::Mat& image);
+
+private:
+    struct Entry
+    {
+        cv::Mat image;
+        qint64 bytes;
+        std::list<QString>::iterator lruIt;
+    };
+
+    // decode() without its trace span.
+    static cv::Mat readImage(const QString& path);
+    void insert(const QString& path, const cv::Mat& image);
+    void evict();
+    void runPrefetch(const QString& path);
+
+    QHash<QString, Entry> entries;
+    std::list<QString> lru;
+    QSet<QString> inFlight;
+    QSet<QString> wanted;
+    qint64 budgetBytes;
+    qint64 usedBytes;
+    int prefetchN;
+    mutable QMutex mutex;
+    QWaitCondition decodedCondition;
+    QThreadPool pool;
+};
+
+#endif // IMAGE_CACHE_H
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "image_convert.h"
+#include "trace.h"
+
+QImage cvMatToQImage(const cv::Mat& mat)
+{
+    TRACE_SCOPE("convert");
+    // The returned QImage wraps the Mat's buffer without copying. A heap Mat
+    // header keeps a reference on the data until the last QImage copy is gone.
+    QImage::Format format;
+    cv::Mat* ref;
+    if (mat.type() == CV_8UC3)
+    {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+        format = QImage::Format_BGR888;
+        ref = new cv::Mat(mat);
+#else
+        format = QImage::Format_RGB888;
+        ref = new cv::Mat();
+        cv::cvtColor(mat, *ref, cv::COLOR_BGR2RGB);
+#endif
+    }
+    else if (mat.type() == CV_8UC1)
+    {
+        format = QImage::Format_Grayscale8;
+        ref = new cv::Mat(mat);
+    }
+    else if (mat.type() == CV_8UC4)
+    {
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+        // ARGB32 is B, G, R, A in memory on little-endian machines.
+        format = QImage::Format_ARGB32;
+        ref = new cv::Mat(mat);
+#else
+        format = QImage::Format_RGBA8888;
+        ref = new cv::Mat();
+        cv::cvtColor(mat, *ref, cv::COLOR_BGRA2RGBA);
+#endif
+    }
+    else
+    {
+        return QImage();
+    }
+    return QImage(
+        static_cast<const uchar*>(ref->data), ref->cols, ref->rows, static_cast<int>(ref->step), format, [](void* info) { delete static_cast<cv::Mat*>(info); }, ref);
+}
@@ -0,0 +1,15 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef IMAGE_CONVERT_H
+#define IMAGE_CONVERT_H
+
+#include <QImage>
+#include <opencv2/opencv.hpp>
+
+QImage cvMatToQImage(const cv::Mat& mat);
+
+#endif // IMAGE_CONVERT_H
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "image_list.h"
+#include <algorithm>
+#include <cstring>
+
+void ImageList::reset(const QString& directory)
+{
+    clear();
+    dir = directory;
+}
+
+void ImageList::clear()
+{
+    dir.clear();
+    blob.clear();
+    offsets.clear();
+    offsets.shrink_to_fit();
+    sorted = true;
+}
+
+QString ImageList::path(int index) const
+{
+    return dir + '/' + QString::fromUtf8(name(index));
+}
+
+void ImageList::append(const QByteArray& fileName)
+{
+    if (sorted && !offsets.empty() && std::strcmp(name(size() - 1), fileName.constData()) > 0)
+        sorted = false;
+    offsets.push_back(static_cast<quint32>(blob.size()));
+    blob.append(fileName);
+    blob.append('\0');
+}
+
+int ImageList::sort(int keepIndex)
+{
+    quint32 keepOffset = keepIndex >= 0 && keepIndex < size() ? offsets[keepIndex] : 0;
+    if (!sorted)
+    {
+        const char* base = blob.constData();
+        std::sort(offsets.begin(), offsets.end(), [base](quint32 a, quint32 b) { return std::strcmp(base + a, base + b) < 0; });
+        sorted = true;
+    }
+    if (keepIndex < 0 || keepIndex >= size())
+        return -1;
+    return indexOf(QByteArray(blob.constData() + keepOffset));
+}
+
+int ImageList::insertSorted(const QByteArray& fileName)
+{
+    const char* base = blob.constData();
+    auto it = std::lower_bound(offsets.begin(), offsets.end(), fileName.constData(), [base](quint32 a, const char* b) { return std::strcmp(base + a, b) < 0; });
+    size_t index = it - offsets.begin();
+    quint32 offset = static_cast<quint32>(blob.size());
+    blob.append(fileName);
+    blob.append('\0');
+    offsets.insert(offsets.begin() + index, offset);
+    return static_cast<int>(index);
+}
+
+int ImageList::indexOf(const QByteArray& fileName) const
+{
+    const char* base = blob.constData();
+    if (sorted)
+    {
+        auto it = std::lower_bound(offsets.begin(), offsets.end(), fileName.constData(), [base](quint32 a, const char* b) { return std::strcmp(base + a, b) < 0; });
+        if (it != offsets.end() && std::strcmp(base + *it, fileName.constData()) == 0)
+            return static_cast<int>(it - offsets.begin());
+        return -1;
+    }
+    for (size_t i = 0; i < offsets.size(); i++)
+    {
+        if (std::strcmp(base + offsets[i], fileName.constData()) == 0)
+            return static_cast<int>(i);
+    }
+    return -1;
+}
+
+void ImageList::select(const std::vector<int>& indices)
+{
+    std::vector<quint32> selected;
+    selected.reserve(indices.size());
+    for (int i : indices)
+        selected.push_back(offsets[i]);
+    offsets.swap(selected);
+    const char* base = blob.constData();
+    // A filter that keeps the order leaves the list sorted.
+    sorted = std::is_sorted(offsets.begin(), offsets.end(), [base](quint32 a, quint32 b) { return std::strcmp(base + a, base + b) < 0; });
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef IMAGE_LIST_H
+#define IMAGE_LIST_H
+
+#include <QByteArray>
+#include <QString>
+#include <vector>
+
+// File names of one directory, stored as a single NUL-separated UTF-8 blob
+// plus 32-bit offsets: about name length + 5 bytes per entry instead of a
+// QString per absolute path. Absolute paths are built on demand.
+class ImageList
+{
+public:
+    void reset(const QString& directory);
+    void clear();
+
+    const QString& directory() const { return dir; }
+    int size() const { return static_cast<int>(offsets.size()); }
+    bool isEmpty() const { return offsets.empty(); }
+    bool isSorted() const { return sorted; }
+
+    const char* name(int index) const { return blob.constData() + offsets[index]; }
+    QString path(int index) const;
+
+    void append(const QByteArray& fileName);
+    // Sorts by name; returns the new index of the entry at keepIndex.
+    int sort(int keepIndex = -1);
+    // Requires a sorted list; returns the index the name was inserted at.
+    int insertSorted(const QByteArray& fileName);
+    int indexOf(const QByteArray& fileName) const;
+    // Keeps only the entries at indices, in that order. The blob is left as
+    // is, so dropped names still occupy memory until the next reset().
+    void select(const std::vector<int>& indices);
+
+private:
+    QString dir;
+    QByteArray blob;
+    std::vector<quint32> offsets;
+    bool sorted = true;
+};
+
+#endif // IMAGE_LIST_H
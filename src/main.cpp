@@ -5,45 +5,56 @@
  */
 
 #include <QAction>
+#include <QActionGroup>
 #include <QApplication>
+#include <QCommandLineParser>
 #include <QDebug>
 #include <QDir>
-#include <QFile>
+#include <QDockWidget>
 #include <QFileDialog>
+#include <QFileInfo>
 #include <QGesture>
 #include <QGraphicsPixmapItem>
 #include <QGraphicsScene>
 #include <QGraphicsView>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPainter>
 #include <QKeyEvent>
 #include <QMainWindow>
 #include <QMenu>
 #include <QMenuBar>
 #include <QPinchGesture>
-#include <QPluginLoader>
-#include <QTextStream>
+#include <QSignalBlocker>
+#include <QStatusBar>
+#include <QTemporaryDir>
+#include <QTimer>
 #include <QVBoxLayout>
 #include <QWidget>
 #include <QtMath>
+#include <algorithm>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <numeric>
 #include <opencv2/opencv.hpp>
 
 #include "ai_plugin_interface.h"
 #include "ai_plugin_manager.h"
-
-QImage cvMatToQImage(const cv::Mat& mat)
-{
-    if (mat.type() == CV_8UC3)
-    {
-        cv::Mat rgb;
-        cv::cvtColor(mat, rgb, cv::COLOR_BGR2RGB);
-        return QImage(rgb.data, rgb.cols, rgb.rows, static_cast<int>(rgb.step), QImage::Format_RGB888).copy();
-    }
-    else if (mat.type() == CV_8UC1)
-    {
-        return QImage(mat.data, mat.cols, mat.rows, static_cast<int>(mat.step), QImage::Format_Grayscale8).copy();
-    }
-    return QImage();
-}
+#include "app_config.h"
+#include "color_index.h"
+#include "directory_scanner.h"
+#include "frame_pipeline.h"
+#include "frame_pool.h"
+#include "image_cache.h"
+#include "image_convert.h"
+#include "image_list.h"
+#include "navigation_benchmark.h"
+#include "thumbnail_grid.h"
+#include "tiled_image_item.h"
+#include "tone_map.h"
+#include "trace.h"
 
 class ImageGraphicsView : public QGraphicsView
 {
@@ -71,9 +82,32 @@ public:
         zoomFactor = 1.0;
         updateTransform();
     }
+    double fitFactor(const QSizeF& size) const
+    {
+        if (size.width() >= size.height())
+            return viewport()->width() / size.width();
+        return viewport()->height() / size.height();
+    }
+    double zoom() const { return zoomFactor; }
+    // Serial of the image the next paint will show; see framePresented.
+    void setPendingFrame(quint64 serial)
+    {
+        pendingFrame = serial;
+        emit frameScheduled(serial);
+    }
+    void setTimingOverlayVisible(bool visible)
+    {
+        timingOverlay = visible;
+        viewport()->update();
+    }
 signals:
-    void nextImageRequested();
-    void previousImageRequested();
+    void nextImageRequested(bool autoRepeat);
+    void previousImageRequested(bool autoRepeat);
+    void navigationReleased();
+    // When a new image is set, before it is painted.
+    void frameScheduled(quint64 serial);
+    // After every paint, with the serial of the image it showed.
+    void framePresented(quint64 serial);
 
 protected:
     bool event(QEvent* event) override
@@ -114,41 +148,79 @@ protected:
     {
         if (event->key() == Qt::Key_Right)
         {
-            emit nextImageRequested();
+            emit nextImageRequested(event->isAutoRepeat());
             event->accept();
             return;
         }
         else if (event->key() == Qt::Key_Left)
         {
-            emit previousImageRequested();
+            emit previousImageRequested(event->isAutoRepeat());
             event->accept();
             return;
         }
         QGraphicsView::keyPressEvent(event);
     }
+    void keyReleaseEvent(QKeyEvent* event) override
+    {
+        if ((event->key() == Qt::Key_Right || event->key() == Qt::Key_Left) && !event->isAutoRepeat())
+        {
+            emit navigationReleased();
+            event->accept();
+            return;
+        }
+        QGraphicsView::keyReleaseEvent(event);
+    }
     void resizeEvent(QResizeEvent* event) override
     {
         QGraphicsView::resizeEvent(event);
         updateTransform();
     }
+    void paintEvent(QPaintEvent* event) override
+    {
+        {
+            TRACE_SCOPE("paint");
+            QGraphicsView::paintEvent(event);
+        }
+        emit framePresented(pendingFrame);
+    }
+    void drawForeground(QPainter* painter, const QRectF& rect) override
+    {
+        QGraphicsView::drawForeground(painter, rect);
+        if (!timingOverlay)
+            return;
+        QStringList lines;
+        for (const auto& d : Trace::frameDurations())
+            lines << QString("%1  %2 ms").arg(d.first, -16).arg(d.second, 0, 'f', 2);
+        if (lines.isEmpty())
+            lines << "no spans recorded";
+        const FramePool::Stats pool = FramePool::instance()->stats();
+        lines << QString("frame pool  %1 hits / %2 misses, %3 MB held, %4 MB in use")
+                     .arg(pool.hits)
+                     .arg(pool.misses)
+                     .arg(pool.bytesHeld / (1024 * 1024))
+                     .arg(pool.bytesInUse / (1024 * 1024));
+        painter->save();
+        painter->resetTransform();
+        QFont font("monospace");
+        font.setStyleHint(QFont::TypeWriter);
+        painter->setFont(font);
+        QRect box = painter->fontMetrics().boundingRect(QRect(0, 0, 1000, 1000), Qt::AlignLeft | Qt::AlignTop, lines.join('\n'));
+        box.moveTopLeft(QPoint(8, 8));
+        painter->fillRect(box.adjusted(-4, -4, 4, 4), QColor(0, 0, 0, 160));
+        painter->setPen(Qt::white);
+        painter->drawText(box, Qt::AlignLeft | Qt::AlignTop, lines.join('\n'));
+        painter->restore();
+    }
 
 private:
     double zoomFactor;
+    quint64 pendingFrame = 0;
+    bool timingOverlay = false;
     void updateTransform()
     {
-        if (!scene() || scene()->items().isEmpty())
+        if (!scene() || scene()->sceneRect().isEmpty())
             return;
-        QGraphicsItem* item = scene()->items().first();
-        QRectF itemRect = item->boundingRect();
-        double baseFactor;
-        if (itemRect.width() >= itemRect.height())
-        {
-            baseFactor = viewport()->width() / itemRect.width();
-        }
-        else
-        {
-            baseFactor = viewport()->height() / itemRect.height();
-        }
+        double baseFactor = fitFactor(scene()->sceneRect().size());
         QTransform transform;
         transform.scale(baseFactor * zoomFactor, baseFactor * zoomFactor);
         setTransform(transform);
@@ -171,31 +243,150 @@ public:
     }
     ImageGraphicsView* getView() const { return view; }
 
-    bool loadImage(const QString& filePath)
+    // Stores the image for the next showOriginal or updateImage call; the
+    // first frame shown after this resets the zoom. High-bit-depth and
+    // grayscale images are kept as decoded for display mapping, while
+    // getOriginalImage returns the 8-bit BGR form plugins expect.
+    bool setImage(const cv::Mat& img)
     {
-        cv::Mat img = cv::imread(filePath.toStdString(), cv::IMREAD_COLOR);
         if (img.empty())
             return false;
-        currentImage = img;
-        updateImage(currentImage);
+        sourceImage = img;
+        autoMapping = autoDisplayMapping(img);
+        currentImage = toBgr8(img, autoMapping);
+        resetZoomPending = true;
         return true;
     }
 
     cv::Mat getOriginalImage() const { return currentImage; }
 
+    // Shows the stored image through the display mapping.
+    bool showOriginal()
+    {
+        cv::Mat display = currentImage;
+        if (sourceImage.type() != CV_8UC3 || exposure != 0.0 || curve != DisplayMapping::Linear || blackShift != 0.0 || whiteShift != 0.0)
+        {
+            DisplayMapping mapping = autoMapping;
+            mapping.exposure += exposure;
+            mapping.curve = curve;
+            // Shifts are fractions of the automatic window, so a step does the
+            // same on every depth; the window never closes completely.
+            const double range = mapping.white - mapping.black;
+            mapping.black += blackShift * range;
+            mapping.white = std::max(mapping.black + 0.01 * range, mapping.white + whiteShift * range);
+            display = toneMap(sourceImage, mapping);
+        }
+        bool shown = updateImage(display);
+        showingOriginal = shown;
+        return shown;
+    }
+
+    // Re-maps the stored image if it is on screen; rendered results are left alone.
+    void setDisplayAdjustment(double exposureStops, DisplayMapping::Curve toneCurve, double blackPointShift, double whitePointShift)
+    {
+        exposure = exposureStops;
+        curve = toneCurve;
+        blackShift = blackPointShift;
+        whiteShift = whitePointShift;
+        if (showingOriginal)
+            showOriginal();
+    }
+
+    // Part of the current image the view will show, in image pixels, and the
+    // display pixels per image pixel. A pending zoom reset means the whole
+    // image at the fit-to-window scale.
+    QRect visibleImageRect() const
+    {
+        QRect bounds(0, 0, currentImage.cols, currentImage.rows);
+        if (resetZoomPending)
+            return bounds;
+        return view->mapToScene(view->viewport()->rect()).boundingRect().toAlignedRect().intersected(bounds);
+    }
+    double displayScale() const
+    {
+        if (resetZoomPending)
+            return view->fitFactor(QSizeF(currentImage.cols, currentImage.rows));
+        return view->fitFactor(scene->sceneRect().size()) * view->zoom();
+    }
+
+    // Draws a reduced-scale result for roi over the image until the next updateImage.
+    void showRegion(const cv::Mat& result, const QRect& roi)
+    {
+        if (resetZoomPending && !showOriginal())
+            return;
+        QImage qimg = cvMatToQImage(result);
+        if (qimg.isNull() || roi.isEmpty())
+            return;
+        if (!regionItem)
+        {
+            regionItem = scene->addPixmap(QPixmap());
+            regionItem->setZValue(1);
+            regionItem->setTransformationMode(Qt::SmoothTransformation);
+        }
+        regionItem->setPixmap(QPixmap::fromImage(std::move(qimg)));
+        regionItem->setPos(roi.topLeft());
+        regionItem->setScale(static_cast<double>(roi.width()) / result.cols);
+        regionItem->show();
+    }
+
     bool updateImage(const cv::Mat& img)
     {
-        QImage qimg = cvMatToQImage(img);
-        if (qimg.isNull())
+        if (img.empty())
             return false;
-        if (pixmapItem)
+        showingOriginal = false;
+        view->setPendingFrame(++frameSerial);
+        if (regionItem)
+            regionItem->hide();
+        QRectF rect;
+        if (std::max(img.cols, img.rows) > tiledThreshold)
         {
-            scene->removeItem(pixmapItem);
-            delete pixmapItem;
+            // Too large for one pixmap: tiles are uploaded as they become visible.
+            if (img.type() != CV_8UC3 && img.type() != CV_8UC1)
+                return false;
+            if (pixmapItem)
+                pixmapItem->setPixmap(QPixmap());
+            if (!tiledItem)
+            {
+                tiledItem = new TiledImageItem();
+                scene->addItem(tiledItem);
+            }
+            if (tiledItem->imageSize() != QSize(img.cols, img.rows))
+                resetZoomPending = true;
+            tiledItem->setImage(img);
+            rect = tiledItem->boundingRect();
+        }
+        else
+        {
+            QImage qimg = cvMatToQImage(img);
+            if (qimg.isNull())
+                return false;
+            if (tiledItem)
+                tiledItem->clear();
+            // Uploading to the pixmap is the only full-frame copy on this path.
+            QPixmap pixmap;
+            {
+                TRACE_SCOPE("upload");
+                pixmap = QPixmap::fromImage(std::move(qimg));
+            }
+            if (!pixmapItem)
+            {
+                pixmapItem = scene->addPixmap(pixmap);
+                resetZoomPending = true;
+            }
+            else
+            {
+                if (pixmapItem->pixmap().size() != pixmap.size())
+                    resetZoomPending = true;
+                pixmapItem->setPixmap(pixmap);
+            }
+            rect = pixmapItem->boundingRect();
+        }
+        if (resetZoomPending)
+        {
+            scene->setSceneRect(rect);
+            view->resetZoom();
+            resetZoomPending = false;
         }
-        pixmapItem = new QGraphicsPixmapItem(QPixmap::fromImage(qimg));
-        scene->addItem(pixmapItem);
-        view->resetZoom();
         return true;
     }
 
@@ -203,62 +394,354 @@ private:
     ImageGraphicsView* view;
     QGraphicsScene* scene;
     QGraphicsPixmapItem* pixmapItem = nullptr;
+    TiledImageItem* tiledItem = nullptr;
+    QGraphicsPixmapItem* regionItem = nullptr;
+    static const int tiledThreshold = 8192;
     cv::Mat currentImage;
+    cv::Mat sourceImage;
+    DisplayMapping autoMapping;
+    double exposure = 0.0;
+    DisplayMapping::Curve curve = DisplayMapping::Linear;
+    double blackShift = 0.0;
+    double whiteShift = 0.0;
+    bool showingOriginal = false;
+    bool resetZoomPending = false;
+    quint64 frameSerial = 0;
 };
 
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
 public:
-    MainWindow(AIPluginManager* manager, QWidget* parent = nullptr) : QMainWindow(parent), aiManager(manager), currentIndex(0)
+    // Without a directory, one is asked for once the window is up.
+    MainWindow(AIPluginManager* manager, ImageCache* cache, const QString& directory = QString(), QWidget* parent = nullptr)
+        : QMainWindow(parent), aiManager(manager), imageCache(cache), currentIndex(0)
     {
         viewer = new ImageViewerWidget(this);
         setCentralWidget(viewer);
 
         connect(viewer->getView(), &ImageGraphicsView::nextImageRequested, this, &MainWindow::loadNextImage);
         connect(viewer->getView(), &ImageGraphicsView::previousImageRequested, this, &MainWindow::loadPreviousImage);
+        connect(viewer->getView(), &ImageGraphicsView::navigationReleased, this, &MainWindow::settleNavigation);
+
+        // Navigation requests only move currentIndex; the zero-interval timer
+        // then shows whichever image is current once queued key events are drained.
+        navigationTimer.setSingleShot(true);
+        navigationTimer.setInterval(0);
+        connect(&navigationTimer, &QTimer::timeout, this, &MainWindow::flushNavigation);
+        settleTimer.setSingleShot(true);
+        settleTimer.setInterval(250);
+        connect(&settleTimer, &QTimer::timeout, this, &MainWindow::settleNavigation);
+        connect(aiManager, &AIPluginManager::taskFinished, this, &MainWindow::onTaskFinished);
+        connect(aiManager, &AIPluginManager::renderFinished, this, &MainWindow::onRenderFinished);
+        connect(aiManager, &AIPluginManager::regionRendered, this, &MainWindow::onRegionRendered);
+        connect(imageCache, &ImageCache::imageDecoded, this, &MainWindow::onImageDecoded);
+
+        pipeline = new FramePipeline(aiManager, this);
+        connect(pipeline, &FramePipeline::frameAvailable, this, &MainWindow::onPlaybackFrame);
+        connect(pipeline, &FramePipeline::finished, this, [this]() { stopPlayback("Playback finished"); });
+        playbackStatsTimer.setInterval(500);
+        connect(&playbackStatsTimer, &QTimer::timeout, this, &MainWindow::showPlaybackStats);
+        connect(aiManager, &AIPluginManager::taskStatusChanged, this, [this](int, int, const QString& msg) { statusBar()->showMessage(msg, 3000); });
+        connect(&scanner, &DirectoryScanner::batchFound, this, &MainWindow::onFilesFound);
+        connect(&scanner, &DirectoryScanner::finished, this, &MainWindow::onScanFinished);
+        connect(&scanner, &DirectoryScanner::filesAdded, this, &MainWindow::onFilesAdded);
+        connect(&colorIndexer, &ColorIndexer::progress, this, [this](int done, int total) { statusBar()->showMessage(QString("Indexing colors... %1/%2").arg(done).arg(total)); });
+        connect(&colorIndexer,
+                &ColorIndexer::finished,
+                this,
+                [this](bool completed)
+                {
+                    if (completed && colorIndex)
+                        statusBar()->showMessage(QString("Color index: %1 images").arg(colorIndex->count()), 3000);
+                });
+
+        thumbnailModel = new ThumbnailModel(&imageFiles, this);
+        thumbnailGrid = new ThumbnailGrid(this);
+        thumbnailGrid->setModel(thumbnailModel);
+        connect(thumbnailGrid, &ThumbnailGrid::imageActivated, this, &MainWindow::jumpToImage);
+        thumbnailDock = new QDockWidget("Thumbnails", this);
+        thumbnailDock->setObjectName("thumbnails");
+        thumbnailDock->setWidget(thumbnailGrid);
+        addDockWidget(Qt::BottomDockWidgetArea, thumbnailDock);
 
         createMenus();
-        loadImageDirectory();
+        // Ask for a directory once the window is up rather than before it appears.
+        if (directory.isEmpty())
+            QTimer::singleShot(0, this, &MainWindow::loadImageDirectory);
+        else
+            QTimer::singleShot(0, this, [this, directory]() { openDirectory(directory); });
+    }
+    ImageGraphicsView* imageView() const { return viewer->getView(); }
+    // Checkable actions of the Models menu, in plugin order.
+    QList<QAction*> modelActions() const
+    {
+        QList<QAction*> actions;
+        for (const auto& p : pluginActions)
+            actions << p.second;
+        return actions;
     }
 private slots:
-    void loadNextImage()
+    void loadNextImage(bool autoRepeat) { requestNavigation(1, autoRepeat); }
+    void loadPreviousImage(bool autoRepeat) { requestNavigation(-1, autoRepeat); }
+
+    void requestNavigation(int step, bool autoRepeat)
     {
         if (imageFiles.isEmpty())
             return;
-        currentIndex = (currentIndex + 1) % imageFiles.size();
-        if (viewer->loadImage(imageFiles[currentIndex]))
-            updateRenderedImage();
+        if (pipeline->isRunning())
+            stopPlayback("Playback stopped");
+        int count = imageFiles.size();
+        currentIndex = ((currentIndex + step) % count + count) % count;
+        navigationDirection = step;
+        navigationHeld = autoRepeat;
+        // Plugin work queued for the image we are leaving is no longer wanted.
+        ++renderRequestId;
+        aiManager->cancelRender();
+        aiManager->cancelAll();
+        if (!navigationTimer.isActive())
+            navigationTimer.start();
     }
-    void loadPreviousImage()
+    void jumpToImage(int index)
     {
-        if (imageFiles.isEmpty())
+        if (index < 0 || index >= imageFiles.size() || (index == currentIndex && !previewShown))
+            return;
+        navigationDirection = index < currentIndex ? -1 : 1;
+        currentIndex = index;
+        navigationHeld = false;
+        ++renderRequestId;
+        aiManager->cancelRender();
+        aiManager->cancelAll();
+        Trace::beginFrame();
+        showImage(currentIndex, navigationDirection);
+    }
+    void flushNavigation()
+    {
+        Trace::beginFrame();
+        if (!navigationHeld)
+        {
+            showImage(currentIndex, navigationDirection);
+            return;
+        }
+        // While a key is held, show the cached frame or a cheap reduced decode
+        // and leave the plugin chain for the image the user stops on. Formats
+        // without one keep the previous frame until the prefetch pool has it.
+        const QString path = imageFiles.path(currentIndex);
+        cv::Mat img = decodedImage(currentIndex);
+        if (img.empty())
+            img = ImageCache::decodeQuick(path);
+        if (img.empty() && ImageCache::hasReducedDecode(path))
+            img = ImageCache::decodePreview(path);
+        if (viewer->setImage(img))
+            viewer->showOriginal();
+        previewShown = true;
+        thumbnailGrid->setCurrentRow(currentIndex);
+        prefetchAround(currentIndex, navigationDirection);
+        settleTimer.start();
+    }
+    void settleNavigation()
+    {
+        settleTimer.stop();
+        navigationHeld = false;
+        if (navigationTimer.isActive() || !previewShown)
+            return;
+        // Without a full decode yet, the one queued for the current image is
+        // swapped in by onImageDecoded; showing the stand-in again gains nothing.
+        cv::Mat img = decodedImage(currentIndex);
+        if (img.empty())
             return;
-        currentIndex = (currentIndex - 1 + imageFiles.size()) % imageFiles.size();
-        if (viewer->loadImage(imageFiles[currentIndex]))
+        Trace::beginFrame();
+        previewShown = false;
+        if (viewer->setImage(img))
             updateRenderedImage();
     }
 
     void updateRenderedImage()
     {
         cv::Mat original = viewer->getOriginalImage();
-        if (original.empty())
+        // Playback keeps the chain it was started with.
+        if (original.empty() || pipeline->isRunning())
             return;
-        cv::Mat rendered = original.clone();
+        std::vector<int> modelIndices = checkedModels();
 
-        for (const auto& p : pluginActions)
+        // Any render still in flight belongs to an older state of the menu or image.
+        ++renderRequestId;
+        if (modelIndices.empty())
         {
-            if (p.second->isChecked())
+            aiManager->cancelRender();
+            viewer->showOriginal();
+            return;
+        }
+        // A preview frame is not the file's content, so it must not be memoized.
+        QByteArray sourceKey = previewShown ? QByteArray() : ResultCache::fileIdentity(imageFiles.path(currentIndex));
+        if (parallelModelsAction->isChecked() && modelIndices.size() > 1)
+        {
+            // Every checked model analyzes the original; their outputs are overlaid.
+            RenderGraph graph;
+            for (int modelIndex : modelIndices)
+                graph.push_back({modelIndex});
+            aiManager->startRenderGraph(renderRequestId, original, graph, sourceKey);
+            return;
+        }
+
+        // On large images, first render what is on screen at display resolution.
+        cv::Rect previewRoi;
+        double previewScale = qMin(1.0, viewer->displayScale());
+        QRect visible = viewer->visibleImageRect();
+        double previewPixels = static_cast<double>(visible.width()) * visible.height() * previewScale * previewScale;
+        if (!visible.isEmpty() && previewPixels * 4 < static_cast<double>(original.total()))
+            previewRoi = cv::Rect(visible.x(), visible.y(), visible.width(), visible.height());
+        aiManager->startRender(renderRequestId, original, modelIndices, sourceKey, previewRoi, previewScale);
+    }
+    void onRegionRendered(quint64 requestId, const cv::Mat& result, const QRect& roi)
+    {
+        if (requestId == renderRequestId && !result.empty())
+            viewer->showRegion(result, roi);
+    }
+    void onRenderFinished(quint64 requestId, const cv::Mat& result)
+    {
+        if (requestId != renderRequestId)
+            return;
+        if (result.empty())
+        {
+            // Also drops a region preview drawn before the failure.
+            viewer->showOriginal();
+            statusBar()->showMessage("Plugins failed on this image; showing the original.", 5000);
+        }
+        else
+            viewer->updateImage(result);
+    }
+    void onFilesFound(quint64 id, const QList<QByteArray>& names)
+    {
+        if (id != scanId)
+            return;
+        bool wasEmpty = imageFiles.isEmpty();
+        for (const QByteArray& name : names)
+            imageFiles.append(name);
+        thumbnailModel->rowsAppended();
+        if (wasEmpty && !imageFiles.isEmpty())
+            showImage(currentIndex, 1);
+        statusBar()->showMessage(QString("Scanning... %1 images").arg(imageFiles.size()));
+    }
+    void onScanFinished(quint64 id)
+    {
+        if (id != scanId)
+            return;
+        scanning = false;
+        // Directory order until now; sort once and stay on the same image.
+        bool reorder = !imageFiles.isSorted();
+        int index = imageFiles.sort(currentIndex);
+        if (reorder)
+            thumbnailModel->rowsReordered();
+        if (index >= 0 && index != currentIndex)
+        {
+            currentIndex = index;
+            taskImageIndex = -1;
+        }
+        QList<QByteArray> additions;
+        additions.swap(pendingAdditions);
+        onFilesAdded(additions);
+        statusBar()->showMessage(QString("%1 images").arg(imageFiles.size()), 3000);
+    }
+    void onFilesAdded(const QList<QByteArray>& names)
+    {
+        if (scanning)
+        {
+            pendingAdditions += names;
+            return;
+        }
+        if (colorFiltered)
+        {
+            // New files appear once the full list is shown again.
+            for (const QByteArray& name : names)
             {
-                cv::Mat output;
-                p.first->render_result(rendered, output);
-                rendered = output.clone();
+                if (unfilteredImages.indexOf(name) < 0)
+                    unfilteredImages.insertSorted(name);
             }
+            return;
         }
-        viewer->updateImage(rendered);
+        bool wasEmpty = imageFiles.isEmpty();
+        for (const QByteArray& name : names)
+        {
+            if (imageFiles.indexOf(name) >= 0)
+            {
+                thumbnailModel->fileChanged(name);
+                continue;
+            }
+            bool hasCurrent = !imageFiles.isEmpty();
+            int index = imageFiles.insertSorted(name);
+            thumbnailModel->rowInserted(index);
+            if (hasCurrent && index <= currentIndex)
+                currentIndex++;
+            if (taskImageIndex >= 0 && index <= taskImageIndex)
+                taskImageIndex++;
+        }
+        if (wasEmpty && !imageFiles.isEmpty())
+            showImage(currentIndex, 1);
+    }
+    void onTaskFinished(int modelIndex, const cv::Mat3b& result)
+    {
+        if (!result.empty() && taskImageIndex == currentIndex)
+            viewer->updateImage(result);
+        qDebug() << "Task for model" << modelIndex << "delivered" << result.cols << "x" << result.rows;
     }
 
+    void onPlaybackFrame()
+    {
+        Frame frame;
+        if (!pipeline->takeFrame(frame))
+            return;
+        Trace::beginFrame();
+        if (playbackFirstFrame)
+        {
+            viewer->setImage(frame.image);
+            playbackFirstFrame = false;
+        }
+        viewer->updateImage(frame.image);
+    }
+    void showPlaybackStats() { statusBar()->showMessage(playbackStatsText()); }
+
 private:
+    QString playbackStatsText() const
+    {
+        FramePipeline::Stats stats = pipeline->stats();
+        return QString("%1 fps  latency %2 ms (max %3)  decoded %4  shown %5  dropped %6")
+            .arg(stats.fps, 0, 'f', 1)
+            .arg(stats.meanLatencyMs, 0, 'f', 1)
+            .arg(stats.maxLatencyMs, 0, 'f', 1)
+            .arg(stats.decoded)
+            .arg(stats.displayed)
+            .arg(stats.dropped);
+    }
+    std::vector<int> checkedModels() const
+    {
+        std::vector<int> modelIndices;
+        for (const auto& p : pluginActions)
+        {
+            if (p.second->isChecked())
+                modelIndices.push_back(p.first);
+        }
+        return modelIndices;
+    }
+    void startPlayback(std::unique_ptr<FrameSource> source)
+    {
+        if (!source)
+        {
+            statusBar()->showMessage("Unable to open the source for playback", 5000);
+            return;
+        }
+        ++renderRequestId;
+        aiManager->cancelRender();
+        playbackFirstFrame = true;
+        pipeline->start(std::move(source), checkedModels(), dropPolicy, realtimeAction->isChecked());
+        playbackStatsTimer.start();
+    }
+    void stopPlayback(const QString& message)
+    {
+        pipeline->stop();
+        playbackStatsTimer.stop();
+        statusBar()->showMessage(message + ": " + playbackStatsText(), 10000);
+    }
     void createMenus()
     {
         QMenuBar* menuBarPtr = menuBar();
@@ -270,7 +753,7 @@ private:
                 &QAction::triggered,
                 [this]()
                 {
-                    if (aiManager->isTaskRunning())
+                    if (aiManager->isTaskRunning(0))
                     {
                         aiManager->cancelTask(0);
                     }
@@ -278,26 +761,37 @@ private:
                     {
                         if (!imageFiles.isEmpty() && currentIndex < imageFiles.size())
                         {
-                            cv::Mat img = cv::imread(imageFiles[currentIndex].toStdString(), cv::IMREAD_COLOR);
+                            cv::Mat img = toBgr8(imageCache->get(imageFiles.path(currentIndex)));
                             if (!img.empty())
-                                aiManager->startTask(0, img, 5);
+                            {
+                                taskImageIndex = currentIndex;
+                                aiManager->startTask(0, img, 5, ResultCache::fileIdentity(imageFiles.path(currentIndex)));
+                            }
                         }
                     }
                 });
         tasksMenu->addAction(startTaskAction);
 
+        QAction* exportResultAction = new QAction("Export Result...", this);
+        connect(exportResultAction, &QAction::triggered, this, [this]() { exportResult(0); });
+        tasksMenu->addAction(exportResultAction);
+
         QMenu* modelsMenu = aiMenu->addMenu("Models");
-        const auto& plugins = aiManager->getPlugins();
-        for (auto plugin : plugins)
+        for (int i = 0; i < aiManager->pluginCount(); i++)
         {
-            QString pluginName = QString::fromStdString(plugin->getName());
+            QString pluginName = aiManager->pluginName(i);
             QAction* pluginAction = new QAction(pluginName, this);
             pluginAction->setCheckable(true);
             connect(pluginAction, &QAction::toggled, this, &MainWindow::updateRenderedImage);
             modelsMenu->addAction(pluginAction);
-            pluginActions.push_back(std::make_pair(plugin, pluginAction));
+            pluginActions.push_back(std::make_pair(i, pluginAction));
         }
 
+        parallelModelsAction = new QAction("Run Models in Parallel", this);
+        parallelModelsAction->setCheckable(true);
+        connect(parallelModelsAction, &QAction::toggled, this, &MainWindow::updateRenderedImage);
+        aiMenu->addAction(parallelModelsAction);
+
         QAction* cancelAllAction = new QAction("cancel_all", this);
         connect(cancelAllAction,
                 &QAction::triggered,
@@ -311,101 +805,556 @@ private:
                     updateRenderedImage();
                 });
         aiMenu->addAction(cancelAllAction);
+
+        QMenu* playbackMenu = menuBarPtr->addMenu("Playback");
+        QAction* openVideoAction = new QAction("Open Video or Sequence...", this);
+        connect(openVideoAction,
+                &QAction::triggered,
+                [this]()
+                {
+                    QString path = QFileDialog::getOpenFileName(this, "Open Video or Image Sequence", imageFiles.directory(), "Video or sequence frame (*)");
+                    if (!path.isEmpty())
+                        startPlayback(FrameSource::open(path));
+                });
+        playbackMenu->addAction(openVideoAction);
+        QAction* playDirectoryAction = new QAction("Play Directory", this);
+        connect(playDirectoryAction,
+                &QAction::triggered,
+                [this]()
+                {
+                    if (!imageFiles.isEmpty())
+                        startPlayback(std::unique_ptr<FrameSource>(new DirectoryFrameSource(imageFiles, currentIndex, 30.0)));
+                });
+        playbackMenu->addAction(playDirectoryAction);
+        QAction* stopAction = new QAction("Stop", this);
+        stopAction->setShortcut(QKeySequence(Qt::Key_Escape));
+        connect(stopAction,
+                &QAction::triggered,
+                [this]()
+                {
+                    if (pipeline->isRunning())
+                        stopPlayback("Playback stopped");
+                });
+        playbackMenu->addAction(stopAction);
+        playbackMenu->addSeparator();
+        realtimeAction = new QAction("Real-time Pacing", this);
+        realtimeAction->setCheckable(true);
+        realtimeAction->setChecked(true);
+        playbackMenu->addAction(realtimeAction);
+        QMenu* dropMenu = playbackMenu->addMenu("When Plugins Fall Behind");
+        QActionGroup* dropGroup = new QActionGroup(this);
+        const std::pair<const char*, DropPolicy> policies[] = {
+            {"Drop Oldest Frames", DropPolicy::DropOldest}, {"Drop New Frames", DropPolicy::DropNewest}, {"Never Drop (slow down)", DropPolicy::Block}};
+        for (const auto& policy : policies)
+        {
+            QAction* action = dropMenu->addAction(policy.first);
+            action->setCheckable(true);
+            action->setChecked(policy.second == dropPolicy);
+            dropGroup->addAction(action);
+            DropPolicy value = policy.second;
+            connect(action, &QAction::triggered, this, [this, value]() { dropPolicy = value; });
+        }
+
+        QMenu* viewMenu = menuBarPtr->addMenu("View");
+        QAction* overlayAction = new QAction("Timing Overlay", this);
+        overlayAction->setCheckable(true);
+        overlayAction->setShortcut(QKeySequence(Qt::Key_T));
+        connect(overlayAction,
+                &QAction::toggled,
+                [this](bool checked)
+                {
+                    // Recording stays on only while something consumes it.
+                    Trace::setEnabled(checked || !qEnvironmentVariable("AIV_TRACE").isEmpty());
+                    viewer->getView()->setTimingOverlayVisible(checked);
+                });
+        viewMenu->addAction(overlayAction);
+
+        QAction* exportTraceAction = new QAction("Export Trace...", this);
+        connect(exportTraceAction,
+                &QAction::triggered,
+                [this]()
+                {
+                    QString path = QFileDialog::getSaveFileName(this, "Export Chrome Trace", "trace.json", "Trace (*.json)");
+                    if (path.isEmpty())
+                        return;
+                    if (!Trace::isEnabled() && Trace::eventCount() == 0)
+                        statusBar()->showMessage("Tracing is off; enable the timing overlay or set AIV_TRACE first.", 5000);
+                    else if (!Trace::exportChromeTrace(path))
+                        statusBar()->showMessage("Failed to write " + path, 5000);
+                });
+        viewMenu->addAction(exportTraceAction);
+
+        QAction* thumbnailsAction = thumbnailDock->toggleViewAction();
+        thumbnailsAction->setShortcut(QKeySequence(Qt::Key_G));
+        viewMenu->addAction(thumbnailsAction);
+
+        // Exposure, window and tone curve re-map the decoded frame; nothing is reloaded.
+        QMenu* displayMenu = viewMenu->addMenu("Display");
+        QAction* brighterAction = new QAction("Increase Exposure", this);
+        brighterAction->setShortcut(QKeySequence(Qt::Key_BracketRight));
+        connect(brighterAction, &QAction::triggered, this, [this]() { setDisplayExposure(displayExposure + 0.5); });
+        displayMenu->addAction(brighterAction);
+        QAction* darkerAction = new QAction("Decrease Exposure", this);
+        darkerAction->setShortcut(QKeySequence(Qt::Key_BracketLeft));
+        connect(darkerAction, &QAction::triggered, this, [this]() { setDisplayExposure(displayExposure - 0.5); });
+        displayMenu->addAction(darkerAction);
+        displayMenu->addSeparator();
+        QAction* raiseBlackAction = new QAction("Raise Black Point", this);
+        raiseBlackAction->setShortcut(QKeySequence("Alt+]"));
+        connect(raiseBlackAction, &QAction::triggered, this, [this]() { setDisplayWindow(displayBlack + 0.05, displayWhite); });
+        displayMenu->addAction(raiseBlackAction);
+        QAction* lowerBlackAction = new QAction("Lower Black Point", this);
+        lowerBlackAction->setShortcut(QKeySequence("Alt+["));
+        connect(lowerBlackAction, &QAction::triggered, this, [this]() { setDisplayWindow(displayBlack - 0.05, displayWhite); });
+        displayMenu->addAction(lowerBlackAction);
+        QAction* raiseWhiteAction = new QAction("Raise White Point", this);
+        raiseWhiteAction->setShortcut(QKeySequence("Ctrl+]"));
+        connect(raiseWhiteAction, &QAction::triggered, this, [this]() { setDisplayWindow(displayBlack, displayWhite + 0.05); });
+        displayMenu->addAction(raiseWhiteAction);
+        QAction* lowerWhiteAction = new QAction("Lower White Point", this);
+        lowerWhiteAction->setShortcut(QKeySequence("Ctrl+["));
+        connect(lowerWhiteAction, &QAction::triggered, this, [this]() { setDisplayWindow(displayBlack, displayWhite - 0.05); });
+        displayMenu->addAction(lowerWhiteAction);
+        displayMenu->addSeparator();
+        reinhardAction = new QAction("Compress Highlights (Reinhard)", this);
+        reinhardAction->setCheckable(true);
+        connect(reinhardAction, &QAction::toggled, this, [this]() { setDisplayExposure(displayExposure); });
+        displayMenu->addAction(reinhardAction);
+        QAction* resetDisplayAction = new QAction("Reset Display", this);
+        resetDisplayAction->setShortcut(QKeySequence(Qt::Key_Backslash));
+        connect(resetDisplayAction,
+                &QAction::triggered,
+                this,
+                [this]()
+                {
+                    QSignalBlocker blocker(reinhardAction);
+                    reinhardAction->setChecked(false);
+                    displayBlack = 0.0;
+                    displayWhite = 0.0;
+                    setDisplayExposure(0.0);
+                });
+        displayMenu->addAction(resetDisplayAction);
+
+        // Histograms are computed once per directory; queries scan the mapped
+        // index and only reorder or filter the list.
+        QMenu* colorMenu = viewMenu->addMenu("Color Index");
+        QAction* buildIndexAction = new QAction("Build Color Index", this);
+        connect(buildIndexAction, &QAction::triggered, this, &MainWindow::buildColorIndex);
+        colorMenu->addAction(buildIndexAction);
+        QAction* similarAction = new QAction("Sort by Similarity to Current Image", this);
+        connect(similarAction, &QAction::triggered, this, &MainWindow::sortBySimilarity);
+        colorMenu->addAction(similarAction);
+        QAction* redAction = new QAction("Show Mostly Red", this);
+        connect(redAction, &QAction::triggered, this, &MainWindow::showMostlyRed);
+        colorMenu->addAction(redAction);
+        QAction* overexposedAction = new QAction("Show Overexposed", this);
+        connect(overexposedAction, &QAction::triggered, this, &MainWindow::showOverexposed);
+        colorMenu->addAction(overexposedAction);
+        QAction* showAllAction = new QAction("Show All Images", this);
+        connect(showAllAction, &QAction::triggered, this, &MainWindow::showAllImages);
+        colorMenu->addAction(showAllAction);
     }
-    void loadImageDirectory()
+    bool ensureColorIndex()
     {
-        QString dirPath = QFileDialog::getExistingDirectory(this, "Select Image Directory");
-        if (dirPath.isEmpty())
-            return;
-        QDir dir(dirPath);
-        QStringList filters;
-        filters << "*.png"
-                << "*.jpg"
-                << "*.jpeg"
-                << "*.bmp";
-        imageFiles = dir.entryList(filters, QDir::Files, QDir::Name);
+        if (imageFiles.directory().isEmpty())
+            return false;
+        if (scanning)
+        {
+            statusBar()->showMessage("Wait for the directory scan to finish.", 3000);
+            return false;
+        }
+        if (!colorIndex)
+        {
+            colorIndex = std::make_shared<ColorIndex>();
+            if (!colorIndex->open(imageFiles.directory()))
+            {
+                colorIndex.reset();
+                statusBar()->showMessage("Failed to open the color index", 5000);
+                return false;
+            }
+        }
+        return true;
+    }
+    void buildColorIndex()
+    {
+        if (ensureColorIndex())
+            colorIndexer.start(colorFiltered ? unfilteredImages : imageFiles, colorIndex);
+    }
+    void sortBySimilarity()
+    {
+        if (imageFiles.isEmpty() || !ensureColorIndex())
+            return;
+        const QByteArray current(imageFiles.name(currentIndex));
+        ColorIndex::Entry entry;
+        if (!colorIndex->isCurrent(current, imageFiles.path(currentIndex)) || !colorIndex->lookup(current, entry))
+        {
+            if (!ColorIndex::compute(imageFiles.path(currentIndex), entry))
+                return;
+            colorIndex->store(current, entry);
+        }
+        const std::vector<quint16> distances = colorIndex->distances(entry.histogram);
+        const std::vector<int> rows = colorIndex->rowsFor(imageFiles);
+        // Images not indexed yet go last, in their current order.
+        auto distance = [&](int i) { return rows[i] >= 0 && rows[i] < static_cast<int>(distances.size()) ? static_cast<int>(distances[rows[i]]) : 0x10000; };
+        std::vector<int> order(imageFiles.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return distance(a) < distance(b); });
+        selectImages(order);
+        statusBar()->showMessage("Sorted by color similarity to " + QString::fromUtf8(current), 5000);
+    }
+    void showMostlyRed()
+    {
+        if (!ensureColorIndex())
+            return;
+        // Red wraps around hue 0, so it is the first and last hue bins; grays
+        // in the lowest saturation bin do not count.
+        ColorIndex::Histogram mask = {};
+        for (int h : {0, ColorIndex::hueBins - 1})
+            for (int s = 1; s < ColorIndex::satBins; s++)
+                for (int v = 0; v < ColorIndex::valBins; v++)
+                    mask[ColorIndex::bin(h, s, v)] = 0xff;
+        const std::vector<quint16> mass = colorIndex->mass(mask);
+        filterImages([&](int row) { return row < static_cast<int>(mass.size()) && mass[row] > 127; }, "mostly red");
+    }
+    void showOverexposed()
+    {
+        if (!ensureColorIndex())
+            return;
+        // More than a fifth of the pixels at or near full value.
+        const std::vector<uchar> clipped = colorIndex->clippedShares();
+        filterImages([&](int row) { return row < static_cast<int>(clipped.size()) && clipped[row] > 51; }, "overexposed");
+    }
+    void showAllImages()
+    {
+        if (!colorFiltered)
+            return;
+        const QByteArray current = imageFiles.isEmpty() ? QByteArray() : QByteArray(imageFiles.name(currentIndex));
+        imageFiles = unfilteredImages;
+        unfilteredImages.clear();
+        colorFiltered = false;
+        relocateCurrent(current);
+        statusBar()->showMessage(QString("%1 images").arg(imageFiles.size()), 3000);
+    }
+    void filterImages(const std::function<bool(int)>& keepRow, const QString& label)
+    {
+        if (colorIndex->count() == 0)
+        {
+            statusBar()->showMessage("Build the color index first.", 5000);
+            return;
+        }
+        const std::vector<int> rows = colorIndex->rowsFor(imageFiles);
+        std::vector<int> kept;
         for (int i = 0; i < imageFiles.size(); i++)
         {
-            imageFiles[i] = dir.absoluteFilePath(imageFiles[i]);
+            if (rows[i] >= 0 && keepRow(rows[i]))
+                kept.push_back(i);
         }
-        if (!imageFiles.isEmpty())
+        if (kept.empty())
+        {
+            statusBar()->showMessage("No indexed images are " + label, 5000);
+            return;
+        }
+        const int total = imageFiles.size();
+        selectImages(kept);
+        statusBar()->showMessage(QString("%1 of %2 images are %3").arg(kept.size()).arg(total).arg(label), 5000);
+    }
+    // Replaces the list with the given entries; the full list is kept for Show All Images.
+    void selectImages(const std::vector<int>& indices)
+    {
+        if (!colorFiltered)
+        {
+            unfilteredImages = imageFiles;
+            colorFiltered = true;
+        }
+        const QByteArray current(imageFiles.name(currentIndex));
+        imageFiles.select(indices);
+        relocateCurrent(current);
+    }
+    void relocateCurrent(const QByteArray& current)
+    {
+        thumbnailModel->rowsReordered();
+        taskImageIndex = -1;
+        int index = current.isEmpty() ? -1 : imageFiles.indexOf(current);
+        if (index >= 0)
+        {
+            currentIndex = index;
+            thumbnailGrid->setCurrentRow(index);
+        }
+        else if (!imageFiles.isEmpty())
         {
             currentIndex = 0;
-            if (viewer->loadImage(imageFiles[currentIndex]))
-                updateRenderedImage();
+            showImage(currentIndex, 1);
+        }
+    }
+    void setDisplayExposure(double stops)
+    {
+        displayExposure = qBound(-10.0, stops, 10.0);
+        applyDisplayAdjustment();
+        statusBar()->showMessage(QString("Exposure %1%2 EV").arg(displayExposure >= 0.0 ? "+" : "").arg(displayExposure, 0, 'f', 1), 2000);
+    }
+    // Shifts of the black and white points, as fractions of the automatic window.
+    void setDisplayWindow(double blackShift, double whiteShift)
+    {
+        displayBlack = qBound(-1.0, blackShift, 0.95);
+        displayWhite = qBound(-0.95, whiteShift, 4.0);
+        applyDisplayAdjustment();
+        auto percent = [](double shift) { return QString("%1%2%").arg(shift >= 0.0 ? "+" : "").arg(qRound(shift * 100)); };
+        statusBar()->showMessage(QString("Black point %1, white point %2").arg(percent(displayBlack), percent(displayWhite)), 2000);
+    }
+    void applyDisplayAdjustment()
+    {
+        viewer->setDisplayAdjustment(displayExposure, reinhardAction->isChecked() ? DisplayMapping::Reinhard : DisplayMapping::Linear, displayBlack, displayWhite);
+    }
+    // Writes the image and mask of a published result, plus its boxes and
+    // scalars as JSON next to it. The result is shared with the manager.
+    void exportResult(int modelIndex)
+    {
+        AIResultPtr result = aiManager->latestResult(modelIndex);
+        if (!result)
+        {
+            statusBar()->showMessage("No result to export; run a task first.", 5000);
+            return;
+        }
+        QString path = QFileDialog::getSaveFileName(this, "Export Result", "result.png", "Images (*.png *.jpg *.bmp)");
+        if (path.isEmpty())
+            return;
+        QFileInfo info(path);
+        QString base = info.absolutePath() + "/" + info.completeBaseName();
+        bool ok = true;
+        if (!result->image().empty())
+            ok &= cv::imwrite(path.toStdString(), result->image());
+        if (!result->mask().empty())
+            ok &= cv::imwrite((base + "_mask.png").toStdString(), result->mask());
+        if (!result->boxes().empty() || !result->scalars().empty())
+        {
+            QJsonArray boxes;
+            for (const AIBox& box : result->boxes())
+            {
+                QJsonObject b;
+                b["x"] = box.rect.x;
+                b["y"] = box.rect.y;
+                b["width"] = box.rect.width;
+                b["height"] = box.rect.height;
+                b["score"] = box.score;
+                b["class"] = box.classId;
+                b["label"] = QString::fromStdString(box.label);
+                boxes.append(b);
+            }
+            QJsonObject scalars;
+            for (const auto& scalar : result->scalars())
+                scalars[QString::fromStdString(scalar.first)] = scalar.second;
+            QJsonObject root;
+            root["producer"] = QString::fromStdString(result->producer());
+            root["sequence"] = QString::number(result->sequence());
+            root["boxes"] = boxes;
+            root["scalars"] = scalars;
+            QFile file(base + ".json");
+            ok &= file.open(QIODevice::WriteOnly | QIODevice::Truncate) && file.write(QJsonDocument(root).toJson()) >= 0;
+        }
+        statusBar()->showMessage(ok ? "Exported " + path : "Failed to export " + path, 5000);
+    }
+    void loadImageDirectory()
+    {
+        QString dirPath = QFileDialog::getExistingDirectory(this, "Select Image Directory");
+        if (!dirPath.isEmpty())
+            openDirectory(dirPath);
+    }
+    void openDirectory(const QString& dirPath)
+    {
+        imageFiles.reset(QDir(dirPath).absolutePath());
+        currentIndex = 0;
+        taskImageIndex = -1;
+        pendingAdditions.clear();
+        colorIndexer.cancel();
+        colorIndex.reset();
+        unfilteredImages.clear();
+        colorFiltered = false;
+        thumbnailModel->setDirectory(imageFiles.directory());
+        scanning = true;
+        scanId = scanner.start(dirPath);
+    }
+    void showImage(int index, int direction)
+    {
+        previewShown = false;
+        const QString path = imageFiles.path(index);
+        cv::Mat img = decodedImage(index);
+        if (img.empty())
+        {
+            // Not decoded yet: show a stand-in now and let the prefetch pool
+            // decode the full image, which onImageDecoded then swaps in.
+            cv::Mat quick = ImageCache::decodeQuick(path);
+            if (viewer->setImage(quick))
+            {
+                viewer->showOriginal();
+                previewShown = true;
+                thumbnailGrid->setCurrentRow(index);
+                prefetchAround(index, direction);
+                return;
+            }
+            img = imageCache->get(path);
         }
+        if (viewer->setImage(img))
+            updateRenderedImage();
+        thumbnailGrid->setCurrentRow(index);
+        // The current image is decoded already, even if too large to cache.
+        prefetchAround(index, direction, false);
+    }
+    // The full decode of an image: cached, or delivered by the prefetch pool
+    // for the current image when it is over the cache budget.
+    cv::Mat decodedImage(int index)
+    {
+        const QString path = imageFiles.path(index);
+        if (path != pendingDecodePath)
+        {
+            pendingDecodePath.clear();
+            pendingDecode.release();
+        }
+        cv::Mat img = imageCache->peek(path);
+        return img.empty() ? pendingDecode : img;
+    }
+    void onImageDecoded(const QString& path, const cv::Mat& image)
+    {
+        if (!previewShown || imageFiles.isEmpty() || path != imageFiles.path(currentIndex))
+            return;
+        // Kept until the key is released; images over the cache budget are
+        // not in the cache to be found again.
+        pendingDecodePath = path;
+        pendingDecode = image;
+        if (navigationHeld)
+            return;
+        previewShown = false;
+        if (viewer->setImage(image))
+            updateRenderedImage();
+    }
+    void prefetchAround(int index, int direction, bool includeCurrent = true)
+    {
+        // Decode ahead in the direction of travel first, then a shorter window behind.
+        int ahead = imageCache->prefetchCount();
+        int behind = ahead > 0 ? qMax(1, ahead / 2) : 0;
+        int count = imageFiles.size();
+        // The current image goes first; it is skipped if already cached.
+        QStringList paths;
+        if (includeCurrent)
+            paths << imageFiles.path(index);
+        for (int i = 1; i <= ahead && i < count; i++)
+            paths << imageFiles.path(((index + direction * i) % count + count) % count);
+        for (int i = 1; i <= behind && i < count; i++)
+            paths << imageFiles.path(((index - direction * i) % count + count) % count);
+        imageCache->prefetch(paths);
     }
     ImageViewerWidget* viewer;
     AIPluginManager* aiManager;
-    QStringList imageFiles;
+    ImageCache* imageCache;
+    DirectoryScanner scanner;
+    ImageList imageFiles;
+    ThumbnailModel* thumbnailModel;
+    ThumbnailGrid* thumbnailGrid;
+    QDockWidget* thumbnailDock;
+    QList<QByteArray> pendingAdditions;
+    ColorIndexer colorIndexer;
+    std::shared_ptr<ColorIndex> colorIndex;
+    ImageList unfilteredImages;
+    bool colorFiltered = false;
+    quint64 scanId = 0;
+    bool scanning = false;
     int currentIndex;
-    std::vector<std::pair<AIPlugin*, QAction*>> pluginActions;
+    int navigationDirection = 1;
+    bool navigationHeld = false;
+    bool previewShown = false;
+    QTimer navigationTimer;
+    QTimer settleTimer;
+    QString pendingDecodePath;
+    cv::Mat pendingDecode;
+    int taskImageIndex = -1;
+    quint64 renderRequestId = 0;
+    std::vector<std::pair<int, QAction*>> pluginActions;
+    FramePipeline* pipeline;
+    QTimer playbackStatsTimer;
+    QAction* realtimeAction = nullptr;
+    QAction* parallelModelsAction = nullptr;
+    QAction* reinhardAction = nullptr;
+    double displayExposure = 0.0;
+    double displayBlack = 0.0;
+    double displayWhite = 0.0;
+    DropPolicy dropPolicy = DropPolicy::DropOldest;
+    bool playbackFirstFrame = false;
 };
 
 int main(int argc, char* argv[])
 {
+    // The platform is chosen when QApplication is constructed, so this cannot
+    // wait for the parser below.
+    bool benchmarkNavigation = false;
+    for (int i = 1; i < argc; i++)
+        benchmarkNavigation |= qstrcmp(argv[i], "--benchmark-navigation") == 0;
+    if (benchmarkNavigation && !qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
     QApplication app(argc, argv);
+    QCoreApplication::setApplicationName("AIPluginViewer");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Image viewer that runs AI plugins on the displayed image.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("directory", "Image directory to open instead of asking for one.", "[directory]");
+    QCommandLineOption benchmarkOption("benchmark-navigation", "Run scripted navigation on generated images and print key-to-paint latency.");
+    QCommandLineOption stepsOption("benchmark-steps", "Steps per navigation benchmark category.", "n", "40");
+    QCommandLineOption sizeOption("benchmark-size", "Size of the generated benchmark images.", "WxH", "4000x3000");
+    QCommandLineOption jsonOption("benchmark-json", "Write navigation benchmark results as JSON to this file.", "path");
+    parser.addOptions({benchmarkOption, stepsOption, sizeOption, jsonOption});
+    parser.process(app);
+
+    // AIV_TRACE=<file> records spans from startup and writes them there on exit.
+    const QString tracePath = qEnvironmentVariable("AIV_TRACE");
+    if (!tracePath.isEmpty())
+        Trace::setEnabled(true);
 
     AIPluginManager* aiManager = new AIPluginManager();
 
-    // tmp yaml file path
-    QString configFilePath = QDir::currentPath() + "/../config/config.yaml";
-    QFile configFile(configFilePath);
-    if (!configFile.open(QIODevice::ReadOnly | QIODevice::Text))
-    {
-        qWarning() << "Failed to open config file:" << configFilePath;
-    }
-    else
+    AppConfig config;
+    bool configLoaded = loadAppConfig(defaultConfigPath(), config);
+    applyCodecConfig(config);
+    // Before plugins load, so their buffers come from the pool as well.
+    FramePool::install(config.framePoolBytes);
+    if (configLoaded)
+        loadPlugins(config, aiManager);
+    ImageCache imageCache(config.cacheBytes, config.prefetch);
+
+    QString directory = parser.positionalArguments().value(0);
+    QTemporaryDir benchmarkDir;
+    if (benchmarkNavigation && directory.isEmpty())
     {
-        QString pluginPath;
-        QTextStream in(&configFile);
-        while (!in.atEnd())
+        // A directory given on the command line is benchmarked as is.
+        QStringList size = parser.value(sizeOption).split('x');
+        int width = size.value(0).toInt();
+        int height = size.value(1).toInt();
+        if (width <= 0 || height <= 0 || !NavigationBenchmark::generateImages(benchmarkDir.path(), 24, width, height))
         {
-            QString line = in.readLine().trimmed();
-            if (line.startsWith("- pluginpath:"))
-            {
-                QStringList parts = line.split(":");
-                if (parts.size() == 2)
-                {
-                    qDebug() << "Plugin path found:" << parts[1];
-                    pluginPath = parts[1].trimmed();
-                }
-
-                break;
-            }
-        }
-        configFile.close();
-        if (!pluginPath.isEmpty())
-        {
-            if (QDir::isRelativePath(pluginPath))
-                pluginPath = QDir::current().absoluteFilePath(pluginPath);
-            QPluginLoader loader(pluginPath);
-            QObject* pluginInstance = loader.instance();
-            qDebug() << "Plugin loaded:" << pluginInstance;
-            if (!pluginInstance)
-            {
-                qWarning() << "Failed to load plugin:" << loader.errorString();
-            }
-            else
-            {
-                AIPlugin* plugin = qobject_cast<AIPlugin*>(pluginInstance);
-                if (plugin)
-                {
-                    aiManager->addPlugin(plugin);
-                    qDebug() << "Plugin loaded successfully:" << pluginPath;
-                }
-                else
-                {
-                    qWarning() << "Failed to cast plugin to AIPlugin.";
-                }
-            }
+            qWarning() << "Failed to generate benchmark images";
+            return 1;
         }
+        directory = benchmarkDir.path();
     }
 
-    MainWindow mainWindow(aiManager);
+    MainWindow mainWindow(aiManager, &imageCache, directory);
     mainWindow.setWindowTitle("AI Plugin Viewer");
+    std::unique_ptr<NavigationBenchmark> benchmark;
+    if (benchmarkNavigation)
+    {
+        mainWindow.resize(1280, 800);
+        NavigationBenchmark::Options options;
+        options.steps = qMax(1, parser.value(stepsOption).toInt());
+        options.jsonPath = parser.value(jsonOption);
+        benchmark.reset(new NavigationBenchmark(mainWindow.imageView(), mainWindow.modelActions(), options));
+        QObject::connect(mainWindow.imageView(), &ImageGraphicsView::frameScheduled, benchmark.get(), &NavigationBenchmark::onFrameScheduled);
+        QObject::connect(mainWindow.imageView(), &ImageGraphicsView::framePresented, benchmark.get(), &NavigationBenchmark::onFramePresented);
+        QObject::connect(benchmark.get(), &NavigationBenchmark::finished, &app, &QCoreApplication::exit);
+        benchmark->start();
+    }
     mainWindow.show();
-    return app.exec();
+    int ret = app.exec();
+    if (!tracePath.isEmpty() && !Trace::exportChromeTrace(tracePath))
+        qWarning() << "Failed to write trace to" << tracePath;
+    return ret;
 }
 
 #include "main.moc"
@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "navigation_benchmark.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QKeyEvent>
+#include <QWheelEvent>
+#include <algorithm>
+#include <cstdio>
+#include <opencv2/opencv.hpp>
+
+NavigationBenchmark::NavigationBenchmark(QWidget* view, const QList<QAction*>& modelActions, const Options& options, QObject* parent)
+    : QObject(parent), view(view), modelActions(modelActions), options(options), next(0), waiting(false), started(false), stepSerial(0), scheduledSerial(0), lastSerial(0), dropped(0)
+{
+    timeout.setSingleShot(true);
+    connect(&timeout, &QTimer::timeout, this, [this]() { complete(true); });
+
+    // Events are posted, not sent, so they queue behind whatever the viewer is
+    // doing exactly like real input.
+    auto key = [this](int code)
+    {
+        return [this, code]()
+        {
+            QCoreApplication::postEvent(this->view, new QKeyEvent(QEvent::KeyPress, code, Qt::NoModifier));
+            QCoreApplication::postEvent(this->view, new QKeyEvent(QEvent::KeyRelease, code, Qt::NoModifier));
+        };
+    };
+    auto wheel = [this](int delta)
+    {
+        return [this, delta]()
+        {
+            QWidget* viewport = this->view->findChild<QWidget*>("qt_scrollarea_viewport");
+            QWidget* target = viewport ? viewport : this->view;
+            QPointF center(target->width() / 2.0, target->height() / 2.0);
+            QCoreApplication::postEvent(
+                target, new QWheelEvent(center, target->mapToGlobal(center.toPoint()), QPoint(), QPoint(0, delta), Qt::NoButton, Qt::NoModifier, Qt::NoScrollPhase, false));
+        };
+    };
+
+    for (int i = 0; i < options.steps; i++)
+        script.push_back({"next", key(Qt::Key_Right), true});
+    for (int i = 0; i < options.steps; i++)
+        script.push_back({"previous", key(Qt::Key_Left), true});
+    for (int i = 0; i < options.steps; i++)
+        script.push_back({"zoom", wheel(i % 2 == 0 ? 120 : -120), false});
+    // Checking a model renders the chain; unchecking shows the original again.
+    for (QAction* action : modelActions)
+    {
+        for (int i = 0; i < options.steps / 4; i++)
+            script.push_back({"model_toggle", [action]() { action->toggle(); }, true});
+    }
+}
+
+bool NavigationBenchmark::generateImages(const QString& dir, int count, int width, int height)
+{
+    if (!QDir().mkpath(dir))
+        return false;
+    // Smoothed noise with a fixed seed per image: reproducible, with a JPEG
+    // cost closer to photographs than flat colors or raw noise.
+    for (int i = 0; i < count; i++)
+    {
+        cv::Mat noise(height / 16 + 1, width / 16 + 1, CV_8UC3);
+        cv::RNG rng(1000 + i);
+        rng.fill(noise, cv::RNG::UNIFORM, 0, 256);
+        cv::Mat image;
+        cv::resize(noise, image, cv::Size(width, height), 0, 0, cv::INTER_CUBIC);
+        QString path = QDir(dir).filePath(QString("nav_%1.jpg").arg(i, 4, 10, QChar('0')));
+        if (!cv::imwrite(path.toStdString(), image))
+            return false;
+    }
+    return true;
+}
+
+void NavigationBenchmark::start()
+{
+    started = true;
+    // The first frame comes from opening the directory.
+    stepSerial = 0;
+    waiting = true;
+    stepTimer.start();
+    timeout.start(options.timeoutMs * 5);
+}
+
+void NavigationBenchmark::onFrameScheduled(quint64 serial)
+{
+    scheduledSerial = std::max(scheduledSerial, serial);
+}
+
+void NavigationBenchmark::onFramePresented(quint64 serial)
+{
+    if (!started)
+        return;
+    if (serial > lastSerial + 1 && lastSerial > 0)
+        dropped += serial - lastSerial - 1;
+    lastSerial = std::max(lastSerial, serial);
+    if (!waiting)
+        return;
+    if (next > 0 && next <= script.size() && script[next - 1].needsNewFrame && serial <= stepSerial)
+        return;
+    if (next == 0 && serial == 0)
+        return;
+    complete(false);
+}
+
+void NavigationBenchmark::complete(bool timedOut)
+{
+    if (!waiting)
+        return;
+    waiting = false;
+    timeout.stop();
+    if (next > 0)
+    {
+        const QString& name = script[next - 1].name;
+        if (timedOut)
+        {
+            timeouts[name]++;
+            settleTimer.start();
+        }
+        else
+            samples[name].push_back(stepTimer.nsecsElapsed() / 1e6);
+    }
+    else if (timedOut)
+    {
+        qWarning() << "No image was shown; is the directory empty?";
+        emit finished(1);
+        return;
+    }
+    QTimer::singleShot(options.gapMs, this, &NavigationBenchmark::runNext);
+}
+
+void NavigationBenchmark::runNext()
+{
+    if (next >= script.size())
+    {
+        emit finished(report());
+        return;
+    }
+    // A step that timed out may still paint its frame; let that land first
+    // so it is neither credited to this step nor delays it.
+    if (settleTimer.isValid() && lastSerial < scheduledSerial && settleTimer.elapsed() < options.timeoutMs)
+    {
+        QTimer::singleShot(options.gapMs, this, &NavigationBenchmark::runNext);
+        return;
+    }
+    settleTimer.invalidate();
+    const Step& step = script[next++];
+    stepSerial = std::max(lastSerial, scheduledSerial);
+    waiting = true;
+    stepTimer.start();
+    timeout.start(options.timeoutMs);
+    step.send();
+}
+
+int NavigationBenchmark::report()
+{
+    QJsonArray results;
+    for (const auto& entry : timeouts)
+    {
+        if (samples.find(entry.first) == samples.end())
+            std::printf("%-16s    0 steps  timeouts %d\n", entry.first.toUtf8().constData(), entry.second);
+    }
+    for (auto& entry : samples)
+    {
+        std::vector<double>& s = entry.second;
+        std::sort(s.begin(), s.end());
+        auto percentile = [&](double p) { return s[std::min(s.size() - 1, static_cast<size_t>(p * s.size()))]; };
+        std::printf("%-16s %4zu steps  p50 %8.2f ms  p95 %8.2f ms  p99 %8.2f ms  max %8.2f ms  timeouts %d\n",
+                    entry.first.toUtf8().constData(),
+                    s.size(),
+                    percentile(0.50),
+                    percentile(0.95),
+                    percentile(0.99),
+                    s.back(),
+                    timeouts[entry.first]);
+        QJsonObject result;
+        result["name"] = entry.first;
+        result["steps"] = static_cast<int>(s.size());
+        result["p50_ms"] = percentile(0.50);
+        result["p95_ms"] = percentile(0.95);
+        result["p99_ms"] = percentile(0.99);
+        result["max_ms"] = s.back();
+        result["timeouts"] = timeouts[entry.first];
+        results.append(result);
+    }
+    std::printf("dropped frames   %llu\n", static_cast<unsigned long long>(dropped));
+    std::fflush(stdout);
+
+    if (!options.jsonPath.isEmpty())
+    {
+        QJsonObject root;
+        root["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+        root["qt_version"] = qVersion();
+        root["dropped_frames"] = static_cast<qint64>(dropped);
+        root["navigation"] = results;
+        QFile file(options.jsonPath);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            qWarning() << "Failed to write" << file.fileName();
+            return 1;
+        }
+        file.write(QJsonDocument(root).toJson());
+    }
+    int totalTimeouts = 0;
+    for (const auto& entry : timeouts)
+        totalTimeouts += entry.second;
+    return samples.empty() || totalTimeouts > 0 ? 2 : 0;
+}
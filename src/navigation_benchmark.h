@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef NAVIGATION_BENCHMARK_H
+#define NAVIGATION_BENCHMARK_H
+
+#include <QAction>
+#include <QElapsedTimer>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <QWidget>
+#include <functional>
+#include <map>
+#include <vector>
+
+// Drives a running viewer with scripted input and measures how long each
+// step takes to reach the screen: Right/Left presses until the new image is
+// painted, wheel zooms and model toggles until the next paint. Connect the
+// view's frameScheduled and framePresented signals to the slots of the same
+// name; finished() carries the process exit code once the report is written.
+class NavigationBenchmark : public QObject
+{
+    Q_OBJECT
+public:
+    struct Options
+    {
+        int steps = 40;
+        // Idle time between steps, so each one starts from a settled viewer.
+        int gapMs = 300;
+        int timeoutMs = 2000;
+        QString jsonPath;
+    };
+
+    NavigationBenchmark(QWidget* view, const QList<QAction*>& modelActions, const Options& options, QObject* parent = nullptr);
+
+    // Writes count images of the given size into dir; returns false on failure.
+    static bool generateImages(const QString& dir, int count, int width, int height);
+
+public slots:
+    // Waits for the first image, then runs the script.
+    void start();
+    void onFrameScheduled(quint64 serial);
+    void onFramePresented(quint64 serial);
+
+signals:
+    void finished(int exitCode);
+
+private:
+    struct Step
+    {
+        QString name;
+        std::function<void()> send;
+        // A new image must be painted, not just a repaint of the current one.
+        bool needsNewFrame;
+    };
+
+    void runNext();
+    void complete(bool timedOut);
+    int report();
+
+    QWidget* view;
+    QList<QAction*> modelActions;
+    Options options;
+    std::vector<Step> script;
+    size_t next;
+    bool waiting;
+    bool started;
+    // Frames scheduled up to stepSerial belong to earlier steps.
+    quint64 stepSerial;
+    quint64 scheduledSerial;
+    quint64 lastSerial;
+    quint64 dropped;
+    QElapsedTimer stepTimer;
+    // Runs from a timeout until the frame that step left pending is painted.
+    QElapsedTimer settleTimer;
+    QTimer timeout;
+    std::map<QString, std::vector<double>> samples;
+    std::map<QString, int> timeouts;
+};
+
+#endif // NAVIGATION_BENCHMARK_H
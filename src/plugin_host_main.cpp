@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QPluginLoader>
+#include <stdexcept>
+#include <opencv2/opencv.hpp>
+#include <string>
+
+#include "ai_plugin_interface.h"
+#include "app_config.h"
+#include "frame_pool.h"
+#include "plugin_host_protocol.h"
+#include "shared_frame_ring.h"
+
+// Runs one plugin on behalf of RemotePlugin. Requests arrive on
+// AIV_PLUGIN_HOST_FD and frames in the shared ring; the loop ends when the
+// viewer closes the socket.
+
+static bool reply(int fd, HostStatus status, const std::string& text = std::string(), quint64 neededBytes = 0)
+{
+    HostReply message;
+    message.status = static_cast<qint32>(status);
+    message.textBytes = static_cast<quint32>(text.size());
+    message.neededBytes = neededBytes;
+    return sendAll(fd, &message, sizeof(message)) && sendAll(fd, text.data(), text.size());
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("AIPluginHost");
+    if (argc < 2)
+    {
+        qWarning() << "usage: AIPluginHost <plugin>";
+        return 1;
+    }
+
+    FramePool::install(AppConfig().framePoolBytes);
+    QPluginLoader loader(QString::fromLocal8Bit(argv[1]));
+    AIPlugin* plugin = qobject_cast<AIPlugin*>(loader.instance());
+    if (!plugin)
+    {
+        qWarning() << "Failed to load plugin:" << argv[1] << loader.errorString();
+        return 1;
+    }
+
+    const int fd = AIV_PLUGIN_HOST_FD;
+    SharedFrameRing ring;
+    HostRequest request;
+    while (recvAll(fd, &request, sizeof(request)))
+    {
+        std::string text(request.textBytes, '\0');
+        if (!recvAll(fd, &text[0], text.size()))
+            break;
+
+        HostStatus status = HostStatus::Ok;
+        std::string message;
+        quint64 neededBytes = 0;
+        try
+        {
+            switch (static_cast<HostOp>(request.op))
+            {
+            case HostOp::OpenRing:
+                if (!ring.attach(QByteArray::fromStdString(text)))
+                    throw std::runtime_error("failed to attach shared frame ring");
+                break;
+            case HostOp::Init:
+            case HostOp::UpdateConfig:
+            {
+                AIConfig config;
+                config.param1 = text;
+                config.param2 = request.param2;
+                if (static_cast<HostOp>(request.op) == HostOp::Init)
+                    plugin->init(config);
+                else
+                    plugin->update_config(config);
+                break;
+            }
+            case HostOp::Fetch:
+            {
+                // Plugins get a refcounted copy, never the slot itself: the
+                // client overwrites slots while a plugin may still hold them.
+                cv::Mat input = ring.view(request.inSlot).clone();
+                if (input.empty())
+                    throw std::runtime_error("invalid input slot");
+                plugin->fetch(input);
+                break;
+            }
+            case HostOp::Render:
+            {
+                cv::Mat input = ring.view(request.inSlot).clone();
+                if (input.empty())
+                    throw std::runtime_error("invalid input slot");
+                // Fresh per request, so a plugin that returned shared storage
+                // last time cannot be written through now.
+                cv::Mat output;
+                plugin->render_result(input, output);
+                if (output.empty())
+                    throw std::runtime_error("plugin returned an empty frame");
+                if (!ring.write(request.outSlot, output))
+                {
+                    status = HostStatus::NeedLargerSlot;
+                    neededBytes = output.total() * output.elemSize();
+                }
+                break;
+            }
+            case HostOp::Deinit:
+                plugin->deinit();
+                break;
+            default:
+                throw std::runtime_error("unknown request");
+            }
+        }
+        catch (const std::exception& e)
+        {
+            status = HostStatus::Error;
+            message = e.what();
+        }
+        if (!reply(fd, status, message, neededBytes))
+            break;
+    }
+    return 0;
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef PLUGIN_HOST_PROTOCOL_H
+#define PLUGIN_HOST_PROTOCOL_H
+
+#include <QtGlobal>
+#include <cerrno>
+#include <cstddef>
+#include <sys/socket.h>
+
+// Control channel between RemotePlugin and AIPluginHost: a stream socket
+// carrying fixed-size requests and replies, each followed by an optional
+// text payload. Pixels never go through it; they live in a SharedFrameRing.
+
+// The host finds its end of the socket pair at this descriptor.
+#define AIV_PLUGIN_HOST_FD 3
+
+enum class HostOp : quint32
+{
+    OpenRing = 1, // text: shared memory name
+    Init,         // text: param1
+    UpdateConfig, // text: param1
+    Fetch,
+    Render,
+    Deinit
+};
+
+enum class HostStatus : qint32
+{
+    Ok = 0,
+    Error,          // text: message
+    NeedLargerSlot, // neededBytes: size of the output frame
+};
+
+struct HostRequest
+{
+    quint32 op;
+    qint32 inSlot;
+    qint32 outSlot;
+    qint32 param2;
+    quint32 textBytes;
+};
+
+struct HostReply
+{
+    qint32 status;
+    quint32 textBytes;
+    quint64 neededBytes;
+};
+
+inline bool sendAll(int fd, const void* data, size_t bytes)
+{
+    const char* p = static_cast<const char*>(data);
+    while (bytes > 0)
+    {
+        // MSG_NOSIGNAL: a dead peer must not raise SIGPIPE in the viewer.
+        ssize_t n = send(fd, p, bytes, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        bytes -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+inline bool recvAll(int fd, void* data, size_t bytes)
+{
+    char* p = static_cast<char*>(data);
+    while (bytes > 0)
+    {
+        ssize_t n = recv(fd, p, bytes, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        bytes -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+#endif // PLUGIN_HOST_PROTOCOL_H
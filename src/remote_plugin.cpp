@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "remote_plugin.h"
+#include <QDebug>
+#include <QFile>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdexcept>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+namespace
+{
+    // Slots 0 and 1 alternate as inputs so consecutive frames never share an
+    // address, which plugins may use to recognize a repeated input.
+    const int outputSlot = 2;
+    const int ringSlots = 3;
+    const quint64 minSlotBytes = 8ULL * 1024 * 1024;
+    // Shared by all proxies in the process so ring names never collide.
+    std::atomic<quint64> ringSerial(0);
+} // namespace
+
+RemotePlugin::RemotePlugin(const QString& hostExecutable, const QString& pluginPath, const std::string& name, const std::string& version)
+    : hostExecutable(hostExecutable), pluginPath(pluginPath), name(name), version(version), pid(-1), fd(-1), nextInputSlot(0), initialized(false),
+      token(nullptr)
+{
+    config.param2 = 0;
+}
+
+RemotePlugin::~RemotePlugin()
+{
+    deinit();
+    stopHost(false);
+}
+
+void RemotePlugin::init(const AIConfig& newConfig)
+{
+    config = newConfig;
+    initialized = true;
+    call(HostOp::Init, -1, -1, config.param2, QByteArray::fromStdString(config.param1));
+}
+
+void RemotePlugin::update_config(const AIConfig& newConfig)
+{
+    config = newConfig;
+    try
+    {
+        call(HostOp::UpdateConfig, -1, -1, config.param2, QByteArray::fromStdString(config.param1));
+    }
+    catch (const std::exception& e)
+    {
+        qWarning() << "update_config failed for" << QString::fromStdString(name) << ":" << e.what();
+    }
+}
+
+void RemotePlugin::deinit()
+{
+    if (!initialized)
+        return;
+    initialized = false;
+    if (pid <= 0)
+        return;
+    try
+    {
+        call(HostOp::Deinit, -1, -1, 0, QByteArray());
+    }
+    catch (const std::exception& e)
+    {
+        qWarning() << "deinit failed for" << QString::fromStdString(name) << ":" << e.what();
+    }
+}
+
+void RemotePlugin::fetch(const cv::Mat& image)
+{
+    int slot = stageInput(image);
+    call(HostOp::Fetch, slot, -1, 0, QByteArray());
+}
+
+void RemotePlugin::render_result(const cv::Mat& input, cv::Mat& output)
+{
+    int slot = stageInput(input);
+    HostReply reply = call(HostOp::Render, slot, outputSlot, 0, QByteArray());
+    if (static_cast<HostStatus>(reply.status) == HostStatus::NeedLargerSlot)
+    {
+        // A new ring has none of the old slots, so stage the input again.
+        ensureRing(reply.neededBytes);
+        slot = stageInput(input);
+        reply = call(HostOp::Render, slot, outputSlot, 0, QByteArray());
+    }
+    if (static_cast<HostStatus>(reply.status) != HostStatus::Ok)
+        throw std::runtime_error("plugin host could not return the result");
+    cv::Mat result = ring.view(outputSlot);
+    if (result.empty())
+        throw std::runtime_error("plugin host returned an invalid frame");
+    result.copyTo(output);
+}
+
+void RemotePlugin::status(AIStatus status, const std::string& msg)
+{
+    qDebug() << "Remote plugin" << QString::fromStdString(name) << "status" << static_cast<int>(status) << QString::fromStdString(msg);
+}
+
+bool RemotePlugin::spawnHost()
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0)
+        return false;
+
+    // dup2 clears close-on-exec, so only the host's end survives exec.
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], AIV_PLUGIN_HOST_FD);
+    QByteArray executable = QFile::encodeName(hostExecutable);
+    QByteArray plugin = QFile::encodeName(pluginPath);
+    char* argv[] = {executable.data(), plugin.data(), nullptr};
+    pid_t child;
+    int error = posix_spawn(&child, executable.constData(), &actions, nullptr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+    if (error != 0)
+    {
+        qWarning() << "Failed to start plugin host" << hostExecutable << std::strerror(error);
+        close(fds[0]);
+        return false;
+    }
+    pid = child;
+    fd = fds[0];
+    qDebug() << "Started plugin host" << pid << "for" << pluginPath;
+    return true;
+}
+
+void RemotePlugin::stopHost(bool kill)
+{
+    if (fd >= 0)
+        close(fd);
+    fd = -1;
+    if (pid > 0)
+    {
+        // Closing the socket ends a healthy host's request loop.
+        if (kill)
+            ::kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+    }
+    pid = -1;
+    ring.release();
+}
+
+HostReply RemotePlugin::call(HostOp op, int inSlot, int outSlot, int param2, const QByteArray& text)
+{
+    if (pid <= 0)
+    {
+        if (!spawnHost())
+            throw std::runtime_error("plugin host could not be started");
+        // A fresh host needs the plugin initialized before anything else.
+        if (initialized && op != HostOp::Init)
+            call(HostOp::Init, -1, -1, config.param2, QByteArray::fromStdString(config.param1));
+    }
+
+    HostRequest request;
+    request.op = static_cast<quint32>(op);
+    request.inSlot = inSlot;
+    request.outSlot = outSlot;
+    request.param2 = param2;
+    request.textBytes = static_cast<quint32>(text.size());
+    if (!sendAll(fd, &request, sizeof(request)) || !sendAll(fd, text.constData(), text.size()))
+    {
+        stopHost(true);
+        throw std::runtime_error("plugin host is gone");
+    }
+
+    // Wait in short steps so an expired deadline can kill a hung host. A
+    // plain cancel still waits: the plugin may stop early on its own, and
+    // restarting the host would cost more than finishing the call.
+    for (;;)
+    {
+        struct pollfd p;
+        p.fd = fd;
+        p.events = POLLIN;
+        int ready = poll(&p, 1, 50);
+        if (ready > 0)
+            break;
+        if (ready < 0 && errno != EINTR)
+        {
+            stopHost(true);
+            throw std::runtime_error("plugin host connection failed");
+        }
+        if (token && token->isExpired())
+        {
+            qWarning() << "Plugin host" << pid << "timed out, killing it";
+            stopHost(true);
+            throw std::runtime_error("plugin host timed out");
+        }
+    }
+
+    HostReply reply;
+    QByteArray message;
+    if (recvAll(fd, &reply, sizeof(reply)))
+    {
+        message.resize(static_cast<int>(reply.textBytes));
+        if (recvAll(fd, message.data(), message.size()))
+        {
+            if (static_cast<HostStatus>(reply.status) == HostStatus::Error)
+                throw std::runtime_error(message.isEmpty() ? "plugin call failed" : message.toStdString());
+            return reply;
+        }
+    }
+    qWarning() << "Plugin host" << pid << "exited unexpectedly";
+    stopHost(false);
+    throw std::runtime_error("plugin host exited");
+}
+
+void RemotePlugin::ensureRing(quint64 bytes)
+{
+    if (ring.isValid() && ring.slotBytes() >= bytes)
+        return;
+    quint64 slotBytes = std::max(minSlotBytes, bytes + bytes / 4);
+    QByteArray shmName = "/aiv-" + QByteArray::number(static_cast<qint64>(getpid())) + "-" + QByteArray::number(++ringSerial);
+    if (!ring.create(shmName, ringSlots, slotBytes))
+        throw std::runtime_error("failed to create shared frame ring");
+    try
+    {
+        // Spawns the host first if needed.
+        call(HostOp::OpenRing, -1, -1, 0, shmName);
+    }
+    catch (...)
+    {
+        ring.release();
+        throw;
+    }
+    // Both sides are mapped; nothing is left behind if either process dies.
+    ring.unlink();
+}
+
+int RemotePlugin::stageInput(const cv::Mat& image)
+{
+    if (image.empty())
+        throw std::runtime_error("empty input");
+    // Always copied: callers may recycle a buffer at the same address for
+    // different pixels, so an address says nothing about what a slot holds.
+    ensureRing(static_cast<quint64>(image.total() * image.elemSize()));
+    int slot = nextInputSlot;
+    nextInputSlot ^= 1;
+    if (!ring.write(slot, image))
+        throw std::runtime_error("input frame does not fit the shared ring");
+    return slot;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef REMOTE_PLUGIN_H
+#define REMOTE_PLUGIN_H
+
+#include <QByteArray>
+#include <QString>
+#include <sys/types.h>
+
+#include "ai_plugin_interface.h"
+#include "plugin_host_protocol.h"
+#include "shared_frame_ring.h"
+
+// Proxy for a plugin running in its own AIPluginHost process. Frames are
+// passed through a SharedFrameRing and calls through a socket, so a crash
+// or hang in the plugin only takes down the host. A dead host is respawned
+// and re-initialized on the next call; a call whose cancel token expires
+// kills the host. Failures surface as std::runtime_error, which the manager
+// reports as task errors.
+class RemotePlugin : public AIPlugin
+{
+public:
+    RemotePlugin(const QString& hostExecutable, const QString& pluginPath, const std::string& name, const std::string& version);
+    ~RemotePlugin();
+
+    void init(const AIConfig& config) override;
+    void update_config(const AIConfig& config) override;
+    void deinit() override;
+    void fetch(const cv::Mat& image) override;
+    void render_result(const cv::Mat& input, cv::Mat& output) override;
+    void cleanup() override {}
+    void status(AIStatus status, const std::string& msg) override;
+    std::string getName() const override { return name; }
+    std::string getVersion() const override { return version; }
+    void set_cancel_token(const AICancelToken* cancelToken) override { token = cancelToken; }
+
+private:
+    bool spawnHost();
+    void stopHost(bool kill);
+    HostReply call(HostOp op, int inSlot, int outSlot, int param2, const QByteArray& text);
+    void ensureRing(quint64 bytes);
+    int stageInput(const cv::Mat& image);
+
+    QString hostExecutable;
+    QString pluginPath;
+    std::string name;
+    std::string version;
+    pid_t pid;
+    int fd;
+    SharedFrameRing ring;
+    int nextInputSlot;
+    AIConfig config;
+    bool initialized;
+    const AICancelToken* token;
+};
+
+#endif // REMOTE_PLUGIN_H
@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "result_cache.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <cstring>
+
+namespace
+{
+    struct FrameHeader
+    {
+        char magic[8];
+        quint32 version;
+        qint32 rows;
+        qint32 cols;
+        qint32 type;
+        quint64 dataBytes;
+    };
+
+    const char frameMagic[8] = {'A', 'I', 'V', 'F', 'R', 'A', 'M', 'E'};
+    const quint32 frameVersion = 1;
+} // namespace
+
+ResultCache::ResultCache(qint64 memoryBudgetBytes) : memoryBudget(memoryBudgetBytes), memoryUsed(0), diskBudget(0), diskUsed(0), hits(0), misses(0)
+{
+}
+
+QByteArray ResultCache::fileIdentity(const QString& path)
+{
+    QFileInfo info(path);
+    if (!info.exists())
+        return QByteArray();
+    return info.absoluteFilePath().toUtf8() + '|' + QByteArray::number(info.lastModified().toMSecsSinceEpoch()) + '|' + QByteArray::number(info.size());
+}
+
+QByteArray ResultCache::makeKey(const QByteArray& sourceIdentity, const QList<QByteArray>& stages)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(sourceIdentity);
+    for (const QByteArray& stage : stages)
+    {
+        hash.addData("\n", 1);
+        hash.addData(stage);
+    }
+    return hash.result().toHex();
+}
+
+cv::Mat ResultCache::lookup(const QByteArray& key)
+{
+    QMutexLocker locker(&mutex);
+    auto it = entries.find(key);
+    if (it != entries.end())
+    {
+        lru.splice(lru.begin(), lru, it->lruIt);
+        hits++;
+        return it->image;
+    }
+    QString path = diskDir.isEmpty() ? QString() : diskPath(key);
+    locker.unlock();
+
+    cv::Mat image = path.isEmpty() ? cv::Mat() : readDisk(path);
+
+    locker.relock();
+    if (image.empty())
+    {
+        misses++;
+        return image;
+    }
+    hits++;
+    insertMemory(key, image);
+    return image;
+}
+
+void ResultCache::store(const QByteArray& key, const cv::Mat& result)
+{
+    if (result.empty())
+        return;
+    QMutexLocker locker(&mutex);
+    insertMemory(key, result);
+    QString path = diskDir.isEmpty() ? QString() : diskPath(key);
+    locker.unlock();
+    if (!path.isEmpty())
+        writeDisk(path, result);
+}
+
+void ResultCache::clear()
+{
+    QMutexLocker locker(&mutex);
+    entries.clear();
+    lru.clear();
+    memoryUsed = 0;
+}
+
+void ResultCache::setMemoryBudget(qint64 bytes)
+{
+    QMutexLocker locker(&mutex);
+    memoryBudget = bytes;
+    while (memoryUsed > memoryBudget && !lru.empty())
+    {
+        auto it = entries.find(lru.back());
+        memoryUsed -= it->bytes;
+        entries.erase(it);
+        lru.pop_back();
+    }
+}
+
+void ResultCache::setDiskDirectory(const QString& dir, qint64 budgetBytes)
+{
+    QMutexLocker locker(&mutex);
+    diskDir = dir;
+    diskBudget = budgetBytes;
+    diskUsed = 0;
+    if (diskDir.isEmpty())
+        return;
+    if (!QDir().mkpath(diskDir))
+    {
+        qWarning() << "Failed to create result cache directory:" << diskDir;
+        diskDir.clear();
+        return;
+    }
+    for (const QFileInfo& info : QDir(diskDir).entryInfoList(QStringList() << "*.frame", QDir::Files))
+        diskUsed += info.size();
+    trimDisk();
+}
+
+quint64 ResultCache::hitCount() const
+{
+    QMutexLocker locker(&mutex);
+    return hits;
+}
+
+quint64 ResultCache::missCount() const
+{
+    QMutexLocker locker(&mutex);
+    return misses;
+}
+
+void ResultCache::insertMemory(const QByteArray& key, const cv::Mat& image)
+{
+    qint64 bytes = static_cast<qint64>(image.total() * image.elemSize());
+    if (bytes > memoryBudget || entries.contains(key))
+        return;
+    lru.push_front(key);
+    Entry entry;
+    entry.image = image;
+    entry.bytes = bytes;
+    entry.lruIt = lru.begin();
+    entries.insert(key, entry);
+    memoryUsed += bytes;
+    while (memoryUsed > memoryBudget && !lru.empty())
+    {
+        auto it = entries.find(lru.back());
+        memoryUsed -= it->bytes;
+        entries.erase(it);
+        lru.pop_back();
+    }
+}
+
+QString ResultCache::diskPath(const QByteArray& key) const
+{
+    return diskDir + "/" + QString::fromLatin1(key) + ".frame";
+}
+
+cv::Mat ResultCache::readDisk(const QString& path) const
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadWrite) || file.size() < static_cast<qint64>(sizeof(FrameHeader)))
+        return cv::Mat();
+    uchar* mapped = file.map(0, file.size());
+    if (!mapped)
+        return cv::Mat();
+
+    FrameHeader header;
+    std::memcpy(&header, mapped, sizeof(header));
+    cv::Mat image;
+    if (std::memcmp(header.magic, frameMagic, sizeof(frameMagic)) == 0 && header.version == frameVersion && header.rows > 0 && header.cols > 0)
+    {
+        cv::Mat view(header.rows, header.cols, header.type, mapped + sizeof(FrameHeader));
+        if (view.total() * view.elemSize() == header.dataBytes && sizeof(FrameHeader) + header.dataBytes <= static_cast<quint64>(file.size()))
+            image = view.clone();
+    }
+    file.unmap(mapped);
+    // The modification time doubles as last-access time for trimming.
+    file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+    return image;
+}
+
+void ResultCache::writeDisk(const QString& path, const cv::Mat& image)
+{
+    FrameHeader header;
+    std::memcpy(header.magic, frameMagic, sizeof(frameMagic));
+    header.version = frameVersion;
+    header.rows = image.rows;
+    header.cols = image.cols;
+    header.type = image.type();
+    header.dataBytes = image.total() * image.elemSize();
+
+    if (QFile::exists(path))
+        return;
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    const qint64 rowBytes = static_cast<qint64>(image.cols * image.elemSize());
+    for (int y = 0; y < image.rows; y++)
+        file.write(reinterpret_cast<const char*>(image.ptr(y)), rowBytes);
+    if (!file.commit())
+    {
+        qWarning() << "Failed to write cached result" << path;
+        return;
+    }
+
+    QMutexLocker locker(&mutex);
+    diskUsed += static_cast<qint64>(sizeof(header) + header.dataBytes);
+    if (diskUsed > diskBudget)
+        trimDisk();
+}
+
+void ResultCache::trimDisk()
+{
+    if (diskBudget <= 0 || diskUsed <= diskBudget)
+        return;
+    // Oldest access first; trim to 90% so we do not rescan on every store.
+    QFileInfoList files = QDir(diskDir).entryInfoList(QStringList() << "*.frame", QDir::Files, QDir::Time | QDir::Reversed);
+    for (const QFileInfo& info : files)
+    {
+        if (diskUsed <= diskBudget * 9 / 10)
+            break;
+        if (QFile::remove(info.absoluteFilePath()))
+            diskUsed -= info.size();
+    }
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <list>
+#include <opencv2/opencv.hpp>
+
+// Memoizes plugin outputs. Keys are opaque digests built by the caller from
+// the source identity and every stage's name, version and config. The memory
+// tier is an LRU bounded by bytes; the optional disk tier stores raw frames
+// that are read back through a memory mapping, so hits survive restarts.
+class ResultCache
+{
+public:
+    explicit ResultCache(qint64 memoryBudgetBytes = 256LL * 1024 * 1024);
+
+    // Identity of an image file: absolute path, modification time and size.
+    static QByteArray fileIdentity(const QString& path);
+    static QByteArray makeKey(const QByteArray& sourceIdentity, const QList<QByteArray>& stages);
+
+    cv::Mat lookup(const QByteArray& key);
+    void store(const QByteArray& key, const cv::Mat& result);
+    void clear();
+
+    void setMemoryBudget(qint64 bytes);
+    // An empty directory disables the disk tier.
+    void setDiskDirectory(const QString& dir, qint64 budgetBytes);
+
+    quint64 hitCount() const;
+    quint64 missCount() const;
+
+private:
+    struct Entry
+    {
+        cv::Mat image;
+        qint64 bytes;
+        std::list<QByteArray>::iterator lruIt;
+    };
+
+    void insertMemory(const QByteArray& key, const cv::Mat& image);
+    cv::Mat readDisk(const QString& path) const;
+    void writeDisk(const QString& path, const cv::Mat& image);
+    void trimDisk();
+    QString diskPath(const QByteArray& key) const;
+
+    QHash<QByteArray, Entry> entries;
+    std::list<QByteArray> lru;
+    qint64 memoryBudget;
+    qint64 memoryUsed;
+    QString diskDir;
+    qint64 diskBudget;
+    qint64 diskUsed;
+    quint64 hits;
+    quint64 misses;
+    mutable QMutex mutex;
+};
+
+#endif // RESULT_CACHE_H
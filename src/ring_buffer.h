@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <utility>
+#include <vector>
+
+// What push() does when the buffer is full.
+enum class DropPolicy
+{
+    Block = 0,  // wait for space: nothing is lost, the producer slows down
+    DropOldest, // overwrite the oldest item: bounded latency
+    DropNewest  // discard the incoming item: keeps already queued work
+};
+
+// Fixed-capacity circular buffer between two pipeline stages. Slots are
+// allocated once; close() wakes every waiter and pop() drains what is left.
+template <typename T>
+class RingBuffer
+{
+public:
+    explicit RingBuffer(size_t capacity, DropPolicy policy = DropPolicy::Block) : slots(capacity > 0 ? capacity : 1), head(0), count(0), dropped(0), policy(policy), closed(false) {}
+
+    // Returns false once closed. A dropped item still counts as accepted.
+    bool push(T item)
+    {
+        QMutexLocker locker(&mutex);
+        while (policy == DropPolicy::Block && count == slots.size() && !closed)
+            notFull.wait(&mutex);
+        if (closed)
+            return false;
+        if (count == slots.size())
+        {
+            dropped++;
+            if (policy == DropPolicy::DropNewest)
+                return true;
+            head = (head + 1) % slots.size();
+            count--;
+        }
+        slots[(head + count) % slots.size()] = std::move(item);
+        count++;
+        notEmpty.wakeOne();
+        return true;
+    }
+
+    bool pop(T& item)
+    {
+        QMutexLocker locker(&mutex);
+        while (count == 0 && !closed)
+            notEmpty.wait(&mutex);
+        if (count == 0)
+            return false;
+        take(item);
+        return true;
+    }
+
+    // Non-blocking: the newest item, discarding older ones.
+    bool popLatest(T& item)
+    {
+        QMutexLocker locker(&mutex);
+        if (count == 0)
+            return false;
+        dropped += count - 1;
+        head = (head + count - 1) % slots.size();
+        count = 1;
+        take(item);
+        return true;
+    }
+
+    void close()
+    {
+        QMutexLocker locker(&mutex);
+        closed = true;
+        notEmpty.wakeAll();
+        notFull.wakeAll();
+    }
+
+    size_t size() const
+    {
+        QMutexLocker locker(&mutex);
+        return count;
+    }
+
+    quint64 droppedCount() const
+    {
+        QMutexLocker locker(&mutex);
+        return dropped;
+    }
+
+private:
+    void take(T& item)
+    {
+        item = std::move(slots[head]);
+        slots[head] = T();
+        head = (head + 1) % slots.size();
+        count--;
+        notFull.wakeOne();
+    }
+
+    std::vector<T> slots;
+    size_t head;
+    size_t count;
+    quint64 dropped;
+    DropPolicy policy;
+    bool closed;
+    mutable QMutex mutex;
+    QWaitCondition notEmpty;
+    QWaitCondition notFull;
+};
+
+#endif // RING_BUFFER_H
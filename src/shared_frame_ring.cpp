@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "shared_frame_ring.h"
+#include <QDebug>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    struct RingHeader
+    {
+        char magic[8];
+        quint32 slotCount;
+        quint32 reserved;
+        quint64 slotBytes;
+    };
+
+    struct SlotHeader
+    {
+        qint32 rows;
+        qint32 cols;
+        qint32 type;
+        qint32 reserved;
+    };
+
+    const char ringMagic[8] = {'A', 'I', 'V', 'R', 'I', 'N', 'G', '1'};
+    // Keeps every slot's pixels page aligned.
+    const quint64 headerBytes = 4096;
+
+    quint64 slotStride(quint64 slotBytes)
+    {
+        return headerBytes + ((slotBytes + headerBytes - 1) / headerBytes) * headerBytes;
+    }
+} // namespace
+
+SharedFrameRing::SharedFrameRing() : base(nullptr), mappedBytes(0), linked(false) {}
+
+SharedFrameRing::~SharedFrameRing()
+{
+    release();
+}
+
+bool SharedFrameRing::create(const QByteArray& name, int slots, quint64 slotBytes)
+{
+    release();
+    int fd = shm_open(name.constData(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+    {
+        qWarning() << "shm_open failed for" << name << std::strerror(errno);
+        return false;
+    }
+    size_t bytes = headerBytes + slots * slotStride(slotBytes);
+    if (ftruncate(fd, static_cast<off_t>(bytes)) != 0)
+    {
+        qWarning() << "Failed to size shared memory" << name << std::strerror(errno);
+        close(fd);
+        shm_unlink(name.constData());
+        return false;
+    }
+    void* mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        shm_unlink(name.constData());
+        return false;
+    }
+    base = static_cast<uchar*>(mapped);
+    mappedBytes = bytes;
+    shmName = name;
+    linked = true;
+    RingHeader* header = reinterpret_cast<RingHeader*>(base);
+    std::memcpy(header->magic, ringMagic, sizeof(ringMagic));
+    header->slotCount = static_cast<quint32>(slots);
+    header->slotBytes = slotBytes;
+    return true;
+}
+
+bool SharedFrameRing::attach(const QByteArray& name)
+{
+    release();
+    int fd = shm_open(name.constData(), O_RDWR, 0600);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    RingHeader header;
+    if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(headerBytes) || pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        std::memcmp(header.magic, ringMagic, sizeof(ringMagic)) != 0 || headerBytes + header.slotCount * slotStride(header.slotBytes) > static_cast<quint64>(info.st_size))
+    {
+        close(fd);
+        return false;
+    }
+    void* mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+        return false;
+    base = static_cast<uchar*>(mapped);
+    mappedBytes = static_cast<size_t>(info.st_size);
+    shmName = name;
+    return true;
+}
+
+void SharedFrameRing::unlink()
+{
+    if (linked)
+        shm_unlink(shmName.constData());
+    linked = false;
+}
+
+void SharedFrameRing::release()
+{
+    unlink();
+    if (base)
+        munmap(base, mappedBytes);
+    base = nullptr;
+    mappedBytes = 0;
+    shmName.clear();
+}
+
+int SharedFrameRing::slotCount() const
+{
+    return base ? static_cast<int>(reinterpret_cast<const RingHeader*>(base)->slotCount) : 0;
+}
+
+quint64 SharedFrameRing::slotBytes() const
+{
+    return base ? reinterpret_cast<const RingHeader*>(base)->slotBytes : 0;
+}
+
+uchar* SharedFrameRing::slotPointer(int slot) const
+{
+    return base + headerBytes + slot * slotStride(slotBytes());
+}
+
+bool SharedFrameRing::write(int slot, const cv::Mat& image)
+{
+    if (!base || slot < 0 || slot >= slotCount() || image.empty())
+        return false;
+    const size_t rowBytes = image.cols * image.elemSize();
+    if (rowBytes * image.rows > slotBytes())
+        return false;
+    uchar* p = slotPointer(slot);
+    SlotHeader* header = reinterpret_cast<SlotHeader*>(p);
+    header->rows = image.rows;
+    header->cols = image.cols;
+    header->type = image.type();
+    uchar* data = p + headerBytes;
+    if (image.isContinuous())
+    {
+        std::memcpy(data, image.data, rowBytes * image.rows);
+    }
+    else
+    {
+        for (int y = 0; y < image.rows; y++)
+            std::memcpy(data + y * rowBytes, image.ptr(y), rowBytes);
+    }
+    return true;
+}
+
+cv::Mat SharedFrameRing::view(int slot) const
+{
+    if (!base || slot < 0 || slot >= slotCount())
+        return cv::Mat();
+    uchar* p = slotPointer(slot);
+    const SlotHeader* header = reinterpret_cast<const SlotHeader*>(p);
+    if (header->rows <= 0 || header->cols <= 0 || (header->type & ~CV_MAT_TYPE_MASK) != 0)
+        return cv::Mat();
+    if (static_cast<quint64>(header->rows) * header->cols * CV_ELEM_SIZE(header->type) > slotBytes())
+        return cv::Mat();
+    return cv::Mat(header->rows, header->cols, header->type, p + headerBytes);
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef SHARED_FRAME_RING_H
+#define SHARED_FRAME_RING_H
+
+#include <QByteArray>
+#include <opencv2/opencv.hpp>
+
+// Fixed-size frame slots in a POSIX shared memory object. One side create()s
+// it and the other attach()es by name; after that the name can be unlinked
+// and both mappings stay valid until released.
+class SharedFrameRing
+{
+public:
+    SharedFrameRing();
+    ~SharedFrameRing();
+
+    bool create(const QByteArray& name, int slots, quint64 slotBytes);
+    bool attach(const QByteArray& name);
+    void unlink();
+    void release();
+
+    bool isValid() const { return base != nullptr; }
+    int slotCount() const;
+    quint64 slotBytes() const;
+
+    // Copies image into the slot; false if it does not fit.
+    bool write(int slot, const cv::Mat& image);
+    // A Mat header over the slot's pixels. Not reference counted: valid until
+    // the slot is written again or the ring is released.
+    cv::Mat view(int slot) const;
+
+private:
+    uchar* slotPointer(int slot) const;
+
+    QByteArray shmName;
+    uchar* base;
+    size_t mappedBytes;
+    bool linked;
+};
+
+#endif // SHARED_FRAME_RING_H
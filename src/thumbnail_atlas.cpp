@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "thumbnail_atlas.h"
+#include "image_cache.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <cstring>
+
+namespace
+{
+    struct AtlasHeader
+    {
+        char magic[8];
+        quint32 version;
+        quint32 cellSize;
+        qint32 slotCount;
+        quint32 reserved;
+    };
+
+    const char atlasMagic[8] = {'A', 'I', 'V', 'T', 'H', 'M', 'B', 'S'};
+    const quint32 atlasVersion = 2;
+    const quint32 slotValid = 0x544f4c53; // "SLOT"
+    const int slotsPerSegment = 256;
+    const qint64 headerBytes = 4096;
+} // namespace
+
+static qint64 slotBytes()
+{
+    return 32 + static_cast<qint64>(ThumbnailAtlas::cellSize) * ThumbnailAtlas::cellSize * 3;
+}
+
+static qint64 segmentBytes()
+{
+    return slotBytes() * slotsPerSegment;
+}
+
+ThumbnailAtlas::ThumbnailAtlas() : header(nullptr), slotCount(0)
+{
+    static_assert(sizeof(SlotHeader) == 32, "slot layout");
+}
+
+ThumbnailAtlas::~ThumbnailAtlas()
+{
+    close();
+}
+
+QString ThumbnailAtlas::atlasPath(const QString& directory)
+{
+    QByteArray digest = QCryptographicHash::hash(QDir(directory).absolutePath().toUtf8(), QCryptographicHash::Sha1).toHex();
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/thumbnails/" + QString::fromLatin1(digest) + ".atlas";
+}
+
+cv::Mat ThumbnailAtlas::makeThumbnail(const QString& path)
+{
+    cv::Mat image = ImageCache::decodePreview(path);
+    if (image.empty())
+        return image;
+    double scale = std::min(1.0, static_cast<double>(cellSize) / std::max(image.cols, image.rows));
+    if (scale >= 1.0)
+        return image;
+    cv::Mat thumbnail;
+    cv::resize(image, thumbnail, cv::Size(std::max(1, cvRound(image.cols * scale)), std::max(1, cvRound(image.rows * scale))), 0, 0, cv::INTER_AREA);
+    return thumbnail;
+}
+
+ThumbnailAtlas::FileStamp ThumbnailAtlas::fileStamp(const QString& path)
+{
+    FileStamp stamp;
+    QFileInfo info(path);
+    if (info.exists())
+    {
+        stamp.modified = info.lastModified().toMSecsSinceEpoch();
+        stamp.size = info.size();
+    }
+    return stamp;
+}
+
+bool ThumbnailAtlas::open(const QString& directory)
+{
+    close();
+    QMutexLocker locker(&mutex);
+    dir = QDir(directory).absolutePath();
+    QString path = atlasPath(directory);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadWrite))
+    {
+        qWarning() << "Failed to open thumbnail atlas" << path;
+        return false;
+    }
+
+    AtlasHeader h;
+    bool fresh = file.size() < headerBytes || file.read(reinterpret_cast<char*>(&h), sizeof(h)) != sizeof(h) || std::memcmp(h.magic, atlasMagic, sizeof(atlasMagic)) != 0 ||
+                 h.version != atlasVersion || h.cellSize != static_cast<quint32>(cellSize) || h.slotCount < 0 ||
+                 headerBytes + ((h.slotCount + slotsPerSegment - 1) / slotsPerSegment) * segmentBytes() > file.size();
+    if (fresh)
+    {
+        std::memset(&h, 0, sizeof(h));
+        std::memcpy(h.magic, atlasMagic, sizeof(atlasMagic));
+        h.version = atlasVersion;
+        h.cellSize = cellSize;
+        if (!file.resize(0) || !file.resize(headerBytes) || !file.seek(0) || file.write(reinterpret_cast<const char*>(&h), sizeof(h)) != sizeof(h) || !file.flush())
+        {
+            qWarning() << "Failed to initialize thumbnail atlas" << path;
+            file.close();
+            return false;
+        }
+    }
+
+    header = file.map(0, headerBytes);
+    if (!header)
+    {
+        file.close();
+        return false;
+    }
+    int segmentCount = (h.slotCount + slotsPerSegment - 1) / slotsPerSegment;
+    for (int s = 0; s < segmentCount; s++)
+    {
+        uchar* segment = file.map(headerBytes + s * segmentBytes(), segmentBytes());
+        if (!segment)
+            break;
+        segments.push_back(segment);
+    }
+    slotCount = std::min(h.slotCount, static_cast<int>(segments.size()) * slotsPerSegment);
+    // A later slot for the same name supersedes an earlier one.
+    for (int i = 0; i < slotCount; i++)
+    {
+        const SlotHeader* slot = reinterpret_cast<const SlotHeader*>(slotPointer(i));
+        if (slot->valid == slotValid && slot->width > 0 && slot->height > 0 && slot->width <= cellSize && slot->height <= cellSize)
+            slots.insert(slot->nameHash, i);
+    }
+    return true;
+}
+
+void ThumbnailAtlas::close()
+{
+    QMutexLocker locker(&mutex);
+    if (!file.isOpen())
+        return;
+    for (uchar* segment : segments)
+        file.unmap(segment);
+    segments.clear();
+    if (header)
+        file.unmap(header);
+    header = nullptr;
+    file.close();
+    dir.clear();
+    slots.clear();
+    slotCount = 0;
+}
+
+cv::Mat ThumbnailAtlas::lookup(const QByteArray& name) const
+{
+    QMutexLocker locker(&mutex);
+    auto it = slots.find(hashName(name));
+    if (it == slots.end())
+        return cv::Mat();
+    uchar* p = slotPointer(it.value());
+    const SlotHeader* slot = reinterpret_cast<const SlotHeader*>(p);
+    return cv::Mat(slot->height, slot->width, CV_8UC3, p + sizeof(SlotHeader), cellSize * 3);
+}
+
+bool ThumbnailAtlas::isCurrent(const QByteArray& name, const FileStamp& stamp) const
+{
+    QMutexLocker locker(&mutex);
+    auto it = slots.find(hashName(name));
+    if (it == slots.end())
+        return false;
+    const SlotHeader* slot = reinterpret_cast<const SlotHeader*>(slotPointer(it.value()));
+    return slot->modified == stamp.modified && slot->size == stamp.size;
+}
+
+bool ThumbnailAtlas::store(const QByteArray& name, const FileStamp& stamp, const cv::Mat& thumbnail)
+{
+    if (stamp.size < 0 || thumbnail.empty() || thumbnail.type() != CV_8UC3 || thumbnail.cols > cellSize || thumbnail.rows > cellSize)
+        return false;
+    QMutexLocker locker(&mutex);
+    if (!header)
+        return false;
+    if (slotCount == static_cast<int>(segments.size()) * slotsPerSegment && !addSegment())
+        return false;
+
+    int index = slotCount;
+    uchar* p = slotPointer(index);
+    for (int y = 0; y < thumbnail.rows; y++)
+        std::memcpy(p + sizeof(SlotHeader) + y * cellSize * 3, thumbnail.ptr(y), thumbnail.cols * 3);
+    SlotHeader* slot = reinterpret_cast<SlotHeader*>(p);
+    slot->nameHash = hashName(name);
+    slot->modified = stamp.modified;
+    slot->size = stamp.size;
+    slot->width = static_cast<quint16>(thumbnail.cols);
+    slot->height = static_cast<quint16>(thumbnail.rows);
+    slot->valid = slotValid;
+
+    slotCount++;
+    reinterpret_cast<AtlasHeader*>(header)->slotCount = slotCount;
+    slots.insert(slot->nameHash, index);
+    return true;
+}
+
+int ThumbnailAtlas::count() const
+{
+    QMutexLocker locker(&mutex);
+    return slots.size();
+}
+
+quint64 ThumbnailAtlas::hashName(const QByteArray& name)
+{
+    // FNV-1a: stable across runs, unlike qHash.
+    quint64 hash = 14695981039346656037ULL;
+    for (char c : name)
+    {
+        hash ^= static_cast<uchar>(c);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+uchar* ThumbnailAtlas::slotPointer(int slot) const
+{
+    return segments[slot / slotsPerSegment] + (slot % slotsPerSegment) * slotBytes();
+}
+
+bool ThumbnailAtlas::addSegment()
+{
+    qint64 offset = headerBytes + static_cast<qint64>(segments.size()) * segmentBytes();
+    if (!file.resize(offset + segmentBytes()))
+        return false;
+    uchar* segment = file.map(offset, segmentBytes());
+    if (!segment)
+        return false;
+    segments.push_back(segment);
+    return true;
+}
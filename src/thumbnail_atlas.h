@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef THUMBNAIL_ATLAS_H
+#define THUMBNAIL_ATLAS_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Thumbnails of one directory in a single file under the cache location.
+// The file is a header followed by fixed-size slots, grown and memory-mapped
+// a segment at a time, so lookups return views into the mapping and a
+// reopened directory needs no decoding. Each slot records the source file's
+// modification time and size; lookups do not touch the source file, so callers
+// check isCurrent() off the GUI thread and store a new thumbnail when it
+// changed. Slots are written once: a changed file gets a new slot and the old
+// one is left behind.
+class ThumbnailAtlas
+{
+public:
+    static const int cellSize = 128;
+
+    // What a thumbnail was made from; taken before decoding, so a file
+    // rewritten meanwhile does not get a stale thumbnail recorded as current.
+    struct FileStamp
+    {
+        qint64 modified = -1;
+        qint64 size = -1;
+    };
+
+    ThumbnailAtlas();
+    ~ThumbnailAtlas();
+
+    static QString atlasPath(const QString& directory);
+    // Reduced decode scaled to fit a cell.
+    static cv::Mat makeThumbnail(const QString& path);
+    static FileStamp fileStamp(const QString& path);
+
+    bool open(const QString& directory);
+    void close();
+
+    // A BGR view into the mapping, valid until close(); empty if not present.
+    // The thumbnail may be stale; see isCurrent().
+    cv::Mat lookup(const QByteArray& name) const;
+    // Whether the newest thumbnail for name was made from a file with stamp.
+    bool isCurrent(const QByteArray& name, const FileStamp& stamp) const;
+    bool store(const QByteArray& name, const FileStamp& stamp, const cv::Mat& thumbnail);
+    int count() const;
+
+private:
+    struct SlotHeader
+    {
+        quint64 nameHash;
+        qint64 modified;
+        qint64 size;
+        quint16 width;
+        quint16 height;
+        quint32 valid;
+    };
+
+    static quint64 hashName(const QByteArray& name);
+    uchar* slotPointer(int slot) const;
+    bool addSegment();
+
+    QString dir;
+    QFile file;
+    uchar* header;
+    std::vector<uchar*> segments;
+    QHash<quint64, int> slots;
+    int slotCount;
+    mutable QMutex mutex;
+};
+
+#endif // THUMBNAIL_ATLAS_H
@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "thumbnail_grid.h"
+#include "image_convert.h"
+#include <QDebug>
+#include <QtConcurrent>
+
+namespace
+{
+    // Requests beyond this were scrolled past long ago.
+    const size_t maxPendingRequests = 512;
+} // namespace
+
+ThumbnailModel::ThumbnailModel(const ImageList* images, QObject* parent) : QAbstractListModel(parent), images(images), rows(0), generation(0), pixmaps(2048), activeWorkers(0)
+{
+    pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() / 2));
+}
+
+ThumbnailModel::~ThumbnailModel()
+{
+    {
+        QMutexLocker locker(&mutex);
+        pending.clear();
+    }
+    pool.waitForDone();
+}
+
+void ThumbnailModel::setDirectory(const QString& directory)
+{
+    beginResetModel();
+    {
+        QMutexLocker locker(&mutex);
+        pending.clear();
+        queued.clear();
+        verified.clear();
+        generation++;
+    }
+    // Workers still holding the previous atlas keep it alive until they finish.
+    atlas = std::make_shared<ThumbnailAtlas>();
+    if (!atlas->open(directory))
+        qWarning() << "Thumbnails for" << directory << "will not be persisted";
+    pixmaps.clear();
+    rows = images->size();
+    endResetModel();
+}
+
+void ThumbnailModel::rowsAppended()
+{
+    int newRows = images->size();
+    if (newRows <= rows)
+        return;
+    beginInsertRows(QModelIndex(), rows, newRows - 1);
+    rows = newRows;
+    endInsertRows();
+}
+
+void ThumbnailModel::rowsReordered()
+{
+    beginResetModel();
+    rows = images->size();
+    endResetModel();
+}
+
+void ThumbnailModel::rowInserted(int row)
+{
+    // A previous file of the same name may have left a slot behind.
+    forget(QByteArray(images->name(row)));
+    beginInsertRows(QModelIndex(), row, row);
+    rows = images->size();
+    endInsertRows();
+}
+
+void ThumbnailModel::fileChanged(const QByteArray& name)
+{
+    forget(name);
+    int row = images->indexOf(name);
+    if (row >= 0 && row < rows)
+    {
+        QModelIndex changed = index(row);
+        emit dataChanged(changed, changed, {Qt::DecorationRole});
+    }
+}
+
+void ThumbnailModel::forget(const QByteArray& name)
+{
+    {
+        QMutexLocker locker(&mutex);
+        // Also retries a name whose previous decode failed.
+        queued.remove(name);
+        verified.remove(name);
+    }
+    pixmaps.remove(name);
+}
+
+int ThumbnailModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : rows;
+}
+
+QVariant ThumbnailModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || index.row() >= rows)
+        return QVariant();
+    int row = index.row();
+    if (role == Qt::ToolTipRole)
+        return QString::fromUtf8(images->name(row));
+    if (role != Qt::DecorationRole)
+        return QVariant();
+
+    const QByteArray name(images->name(row));
+    if (QPixmap* cached = pixmaps.object(name))
+        return *cached;
+    bool checked;
+    {
+        QMutexLocker locker(&mutex);
+        checked = verified.contains(name);
+    }
+    if (!checked)
+        request(row);
+    cv::Mat thumbnail = atlas ? atlas->lookup(name) : cv::Mat();
+    if (thumbnail.empty())
+        return QVariant();
+    // The view points into the atlas mapping; the pixmap upload is the copy.
+    QPixmap* pixmap = new QPixmap(QPixmap::fromImage(cvMatToQImage(thumbnail)));
+    pixmaps.insert(name, pixmap);
+    return *pixmap;
+}
+
+void ThumbnailModel::request(int row) const
+{
+    Request r;
+    r.row = row;
+    r.name = QByteArray(images->name(row));
+    r.path = images->path(row);
+    r.atlas = atlas;
+
+    QMutexLocker locker(&mutex);
+    // Names stay queued after a failed decode so they are not retried on every paint.
+    if (queued.contains(r.name))
+        return;
+    r.generation = generation;
+    queued.insert(r.name);
+    pending.push_front(r);
+    while (pending.size() > maxPendingRequests)
+    {
+        queued.remove(pending.back().name);
+        pending.pop_back();
+    }
+    if (activeWorkers < pool.maxThreadCount())
+    {
+        activeWorkers++;
+        QtConcurrent::run(&pool, const_cast<ThumbnailModel*>(this), &ThumbnailModel::runRequests);
+    }
+}
+
+void ThumbnailModel::runRequests()
+{
+    for (;;)
+    {
+        Request r;
+        {
+            QMutexLocker locker(&mutex);
+            if (pending.empty())
+            {
+                activeWorkers--;
+                return;
+            }
+            r = pending.front();
+            pending.pop_front();
+        }
+
+        const ThumbnailAtlas::FileStamp stamp = ThumbnailAtlas::fileStamp(r.path);
+        if (r.atlas->isCurrent(r.name, stamp))
+        {
+            QMutexLocker locker(&mutex);
+            if (r.generation == generation)
+            {
+                queued.remove(r.name);
+                verified.insert(r.name);
+            }
+            continue;
+        }
+        cv::Mat thumbnail = ThumbnailAtlas::makeThumbnail(r.path);
+        if (!thumbnail.empty() && r.atlas->store(r.name, stamp, thumbnail))
+            QMetaObject::invokeMethod(this, "thumbnailReady", Qt::QueuedConnection, Q_ARG(int, r.row), Q_ARG(QByteArray, r.name), Q_ARG(quint64, r.generation));
+    }
+}
+
+void ThumbnailModel::thumbnailReady(int row, const QByteArray& name, quint64 requestGeneration)
+{
+    {
+        QMutexLocker locker(&mutex);
+        if (requestGeneration != generation)
+            return;
+        queued.remove(name);
+        verified.insert(name);
+    }
+    pixmaps.remove(name);
+    // The list may have been sorted or grown since the request was made.
+    if (row >= rows || name != images->name(row))
+        row = images->indexOf(name);
+    if (row < 0)
+        return;
+    QModelIndex changed = index(row);
+    emit dataChanged(changed, changed, {Qt::DecorationRole});
+}
+
+ThumbnailGrid::ThumbnailGrid(QWidget* parent) : QListView(parent)
+{
+    setViewMode(QListView::IconMode);
+    setMovement(QListView::Static);
+    setResizeMode(QListView::Adjust);
+    setUniformItemSizes(true);
+    // Batched layout keeps million-row models from blocking the event loop.
+    setLayoutMode(QListView::Batched);
+    setBatchSize(1000);
+    setIconSize(QSize(ThumbnailAtlas::cellSize, ThumbnailAtlas::cellSize));
+    setGridSize(QSize(ThumbnailAtlas::cellSize + 8, ThumbnailAtlas::cellSize + 8));
+    setSelectionMode(QAbstractItemView::SingleSelection);
+    setEditTriggers(QAbstractItemView::NoEditTriggers);
+    // Arrow keys keep navigating the main view.
+    setFocusPolicy(Qt::NoFocus);
+    connect(this, &QListView::clicked, this, [this](const QModelIndex& index) { emit imageActivated(index.row()); });
+}
+
+void ThumbnailGrid::setCurrentRow(int row)
+{
+    if (!model() || row < 0 || row >= model()->rowCount())
+        return;
+    QModelIndex index = model()->index(row, 0);
+    setCurrentIndex(index);
+    scrollTo(index);
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef THUMBNAIL_GRID_H
+#define THUMBNAIL_GRID_H
+
+#include <QAbstractListModel>
+#include <QCache>
+#include <QListView>
+#include <QMutex>
+#include <QPixmap>
+#include <QSet>
+#include <QThreadPool>
+#include <deque>
+#include <memory>
+
+#include "image_list.h"
+#include "thumbnail_atlas.h"
+
+// Exposes an ImageList as thumbnails. Rows the view asks for are queued for a
+// background check, newest request first: the worker compares the atlas slot
+// with the file and decodes only what is missing or stale, so the GUI thread
+// never touches the source files. A stored thumbnail is shown meanwhile.
+class ThumbnailModel : public QAbstractListModel
+{
+    Q_OBJECT
+public:
+    explicit ThumbnailModel(const ImageList* images, QObject* parent = nullptr);
+    ~ThumbnailModel();
+
+    // Call after the ImageList was reset for another directory.
+    void setDirectory(const QString& directory);
+    // Call after the ImageList changed: rows appended, reordered or inserted.
+    void rowsAppended();
+    void rowsReordered();
+    void rowInserted(int row);
+    // Call when the scanner reports a file rewritten in place.
+    void fileChanged(const QByteArray& name);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role) const override;
+
+private:
+    struct Request
+    {
+        int row;
+        QByteArray name;
+        QString path;
+        quint64 generation;
+        std::shared_ptr<ThumbnailAtlas> atlas;
+    };
+
+    void forget(const QByteArray& name);
+    void request(int row) const;
+    void runRequests();
+    Q_INVOKABLE void thumbnailReady(int row, const QByteArray& name, quint64 generation);
+
+    const ImageList* images;
+    int rows;
+    std::shared_ptr<ThumbnailAtlas> atlas;
+    quint64 generation;
+    // Keyed by name so inserted and reordered rows keep their pixmaps.
+    mutable QCache<QByteArray, QPixmap> pixmaps;
+    mutable QMutex mutex;
+    mutable std::deque<Request> pending;
+    mutable QSet<QByteArray> queued;
+    // Checked against the file since the directory was opened or the scanner reported it.
+    mutable QSet<QByteArray> verified;
+    mutable int activeWorkers;
+    mutable QThreadPool pool;
+};
+
+class ThumbnailGrid : public QListView
+{
+    Q_OBJECT
+public:
+    explicit ThumbnailGrid(QWidget* parent = nullptr);
+    void setCurrentRow(int row);
+
+signals:
+    void imageActivated(int row);
+};
+
+#endif // THUMBNAIL_GRID_H
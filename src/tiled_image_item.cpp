@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "tiled_image_item.h"
+#include "image_convert.h"
+#include "trace.h"
+#include <QMutexLocker>
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+#include <QTimer>
+#include <QtConcurrent>
+#include <QtMath>
+
+namespace
+{
+    // Uploads beyond this wait for the next paint, so a zoom jump does not
+    // stall one frame on dozens of textures.
+    const int maxUploadsPerPaint = 6;
+} // namespace
+
+TiledImageItem::TiledImageItem(QGraphicsItem* parent) : QGraphicsObject(parent), levelCount(0), generation(0), repaintQueued(false)
+{
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+    // Cost is in KiB.
+    tiles.setMaxCost(256 * 1024);
+    pool.setMaxThreadCount(1);
+}
+
+TiledImageItem::~TiledImageItem()
+{
+    pool.clear();
+    pool.waitForDone();
+}
+
+void TiledImageItem::setImage(const cv::Mat& image)
+{
+    prepareGeometryChange();
+    clear();
+    if (image.empty() || (image.type() != CV_8UC3 && image.type() != CV_8UC1))
+        return;
+    levels.push_back(image);
+    levelCount = 1;
+    int extent = std::max(image.cols, image.rows);
+    while (extent > tileSize)
+    {
+        extent = (extent + 1) / 2;
+        levelCount++;
+    }
+    levels.resize(levelCount);
+    requestLevel(levelCount - 1);
+    update();
+}
+
+void TiledImageItem::clear()
+{
+    levels.clear();
+    levelCount = 0;
+    building.clear();
+    tiles.clear();
+    // Keys of a previous image can never match again.
+    generation++;
+}
+
+void TiledImageItem::setCacheBudget(qint64 bytes)
+{
+    tiles.setMaxCost(static_cast<int>(qMax<qint64>(1, bytes / 1024)));
+}
+
+QRectF TiledImageItem::boundingRect() const
+{
+    return QRectF(QPointF(0, 0), QSizeF(imageSize()));
+}
+
+int TiledImageItem::levelFor(double scale) const
+{
+    // The coarsest level that still has at least one texel per device pixel.
+    int index = scale > 0 ? static_cast<int>(std::floor(std::log2(1.0 / scale))) : 0;
+    return qBound(0, index, levelCount - 1);
+}
+
+int TiledImageItem::readyLevel(int wanted) const
+{
+    // Coarser levels are cheaper to draw, so prefer them over finer ones.
+    for (int i = wanted; i < levelCount; i++)
+    {
+        if (!levels[i].empty())
+            return i;
+    }
+    for (int i = wanted - 1; i >= 0; i--)
+    {
+        if (!levels[i].empty())
+            return i;
+    }
+    return 0;
+}
+
+void TiledImageItem::requestLevel(int index)
+{
+    if (!levels[index].empty() || building.contains(index))
+        return;
+    building.insert(index);
+    // Resize from the finest ready level below; level 0 is always there.
+    int finer = index - 1;
+    while (levels[finer].empty())
+        finer--;
+    cv::Mat source = levels[finer];
+    cv::Size size(source.cols, source.rows);
+    for (int i = finer; i < index; i++)
+        size = cv::Size((size.width + 1) / 2, (size.height + 1) / 2);
+
+    quint64 requestGeneration = generation;
+    QtConcurrent::run(&pool, [this, index, requestGeneration, source, size]() { buildLevel(index, requestGeneration, source, size); });
+}
+
+void TiledImageItem::buildLevel(int index, quint64 requestGeneration, const cv::Mat& source, const cv::Size& size)
+{
+    TRACE_SCOPE("mip_level");
+    BuiltLevel level{index, requestGeneration, cv::Mat()};
+    cv::resize(source, level.image, size, 0, 0, cv::INTER_AREA);
+    {
+        QMutexLocker locker(&builtMutex);
+        built.push_back(level);
+    }
+    QMetaObject::invokeMethod(this, "levelsBuilt", Qt::QueuedConnection);
+}
+
+void TiledImageItem::levelsBuilt()
+{
+    std::vector<BuiltLevel> ready;
+    {
+        QMutexLocker locker(&builtMutex);
+        ready.swap(built);
+    }
+    bool changed = false;
+    for (BuiltLevel& level : ready)
+    {
+        if (level.generation != generation)
+            continue;
+        building.remove(level.index);
+        levels[level.index] = level.image;
+        changed = true;
+    }
+    if (changed)
+        update();
+}
+
+QPixmap* TiledImageItem::tile(int levelIndex, int tx, int ty, int& uploadBudget)
+{
+    quint64 key = (generation << 48) ^ (static_cast<quint64>(levelIndex) << 40) ^ (static_cast<quint64>(ty) << 20) ^ static_cast<quint64>(tx);
+    if (QPixmap* cached = tiles.object(key))
+        return cached;
+    if (uploadBudget <= 0)
+        return nullptr;
+    uploadBudget--;
+
+    TRACE_SCOPE("tile_upload");
+    const cv::Mat& source = levels[levelIndex];
+    cv::Rect rect(tx * tileSize, ty * tileSize, tileSize, tileSize);
+    rect &= cv::Rect(0, 0, source.cols, source.rows);
+    QPixmap* pixmap = new QPixmap(QPixmap::fromImage(cvMatToQImage(source(rect))));
+    tiles.insert(key, pixmap, qMax(1, pixmap->width() * pixmap->height() * 4 / 1024));
+    return tiles.object(key);
+}
+
+void TiledImageItem::paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget)
+{
+    Q_UNUSED(widget);
+    if (levelCount == 0)
+        return;
+    double scale = QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform());
+    int wanted = levelFor(scale);
+    requestLevel(wanted);
+    int levelIndex = readyLevel(wanted);
+    const double span = tileSize * std::ldexp(1.0, levelIndex);
+    QRectF exposed = option->exposedRect.intersected(boundingRect());
+    if (exposed.isEmpty())
+        return;
+
+    const QSize full = imageSize();
+    const int coarsest = levelCount - 1;
+    const double coarseScale = std::ldexp(1.0, -coarsest);
+    int uploads = maxUploadsPerPaint;
+    bool deferred = false;
+    int x0 = static_cast<int>(exposed.left() / span);
+    int y0 = static_cast<int>(exposed.top() / span);
+    int x1 = static_cast<int>(std::ceil(exposed.right() / span));
+    int y1 = static_cast<int>(std::ceil(exposed.bottom() / span));
+    for (int ty = y0; ty < y1; ty++)
+    {
+        for (int tx = x0; tx < x1; tx++)
+        {
+            // Level pixels map back to the source rect this tile covers,
+            // clipped at the image edge so odd sizes do not overhang.
+            QRectF target(tx * span, ty * span, qMin(span, full.width() - tx * span), qMin(span, full.height() - ty * span));
+            QPixmap* pixmap = tile(levelIndex, tx, ty, uploads);
+            if (!pixmap)
+            {
+                deferred = true;
+                int standIn = 1;
+                pixmap = levels[coarsest].empty() ? nullptr : tile(coarsest, 0, 0, standIn);
+                if (pixmap && !pixmap->isNull())
+                {
+                    QRectF source(target.topLeft() * coarseScale, target.size() * coarseScale);
+                    painter->drawPixmap(target, *pixmap, source.intersected(QRectF(pixmap->rect())));
+                }
+                continue;
+            }
+            if (pixmap->isNull())
+                continue;
+            painter->drawPixmap(target, *pixmap, QRectF(pixmap->rect()));
+        }
+    }
+    if (deferred && !repaintQueued)
+    {
+        repaintQueued = true;
+        QTimer::singleShot(0, this, &TiledImageItem::repaintDeferred);
+    }
+}
+
+void TiledImageItem::repaintDeferred()
+{
+    repaintQueued = false;
+    update();
+}
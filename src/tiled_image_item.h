@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef TILED_IMAGE_ITEM_H
+#define TILED_IMAGE_ITEM_H
+
+#include <QCache>
+#include <QGraphicsObject>
+#include <QMutex>
+#include <QPixmap>
+#include <QSet>
+#include <QThreadPool>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Draws a large image as tiles of a mip pyramid. Each paint picks the level
+// closest to the current zoom and uploads only the tiles that intersect the
+// exposed rect, a few per paint; uploaded tiles are kept in an LRU bounded by
+// bytes. Pyramid levels are resized on a worker when first wanted, and the
+// nearest level that is ready is drawn meanwhile. The coarsest level fits one
+// tile and is built up front to stand in for tiles not uploaded yet.
+class TiledImageItem : public QGraphicsObject
+{
+    Q_OBJECT
+public:
+    static const int tileSize = 512;
+
+    explicit TiledImageItem(QGraphicsItem* parent = nullptr);
+    ~TiledImageItem();
+
+    // 8UC3 or 8UC1; the image is shared, not copied.
+    void setImage(const cv::Mat& image);
+    void clear();
+    QSize imageSize() const { return QSize(levels.empty() ? 0 : levels[0].cols, levels.empty() ? 0 : levels[0].rows); }
+    void setCacheBudget(qint64 bytes);
+
+    QRectF boundingRect() const override;
+    void paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget) override;
+
+private:
+    struct BuiltLevel
+    {
+        int index;
+        quint64 generation;
+        cv::Mat image;
+    };
+
+    int levelFor(double scale) const;
+    int readyLevel(int wanted) const;
+    void requestLevel(int index);
+    // Runs on the pool.
+    void buildLevel(int index, quint64 requestGeneration, const cv::Mat& source, const cv::Size& size);
+    Q_INVOKABLE void levelsBuilt();
+    void repaintDeferred();
+    // Null once uploadBudget is spent and the tile is not cached.
+    QPixmap* tile(int levelIndex, int tx, int ty, int& uploadBudget);
+
+    std::vector<cv::Mat> levels;
+    int levelCount;
+    quint64 generation;
+    bool repaintQueued;
+    QSet<int> building;
+    QCache<quint64, QPixmap> tiles;
+    QMutex builtMutex;
+    std::vector<BuiltLevel> built;
+    QThreadPool pool;
+};
+
+#endif // TILED_IMAGE_ITEM_H
@@ -0,0 +1,351 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "tone_map.h"
+#include "trace.h"
+#include <algorithm>
+#include <cmath>
+#include <opencv2/core/hal/intrin.hpp>
+#include <vector>
+
+namespace
+{
+    // Mapped values are quantized to 12 bits and finished through a table, so
+    // the sRGB curve costs one lookup instead of a pow per sample.
+    const int lutSize = 4096;
+
+    struct MapParams
+    {
+        float scale;
+        float offset;
+        bool reinhard;
+        uchar lut[lutSize];
+    };
+
+    template <typename T>
+    struct FormatWhite;
+    template <>
+    struct FormatWhite<uchar>
+    {
+        static constexpr float value = 255.f;
+    };
+    template <>
+    struct FormatWhite<ushort>
+    {
+        static constexpr float value = 65535.f;
+    };
+    template <>
+    struct FormatWhite<float>
+    {
+        static constexpr float value = 1.f;
+    };
+
+    inline int lutIndex(float x, const MapParams& p)
+    {
+        float v = x * p.scale + p.offset;
+        if (!(v > 0.f))
+            v = 0.f;
+        if (p.reinhard)
+            v = v / (1.f + v);
+        int i = cvRound(std::min(v, 1.f) * (lutSize - 1));
+        return std::min(std::max(i, 0), lutSize - 1);
+    }
+
+#if CV_SIMD128
+    inline void load8(const uchar* src, cv::v_float32x4& a, cv::v_float32x4& b)
+    {
+        using namespace cv;
+        v_uint32x4 lo, hi;
+        v_expand(v_load_expand(src), lo, hi);
+        a = v_cvt_f32(v_reinterpret_as_s32(lo));
+        b = v_cvt_f32(v_reinterpret_as_s32(hi));
+    }
+
+    inline void load8(const ushort* src, cv::v_float32x4& a, cv::v_float32x4& b)
+    {
+        using namespace cv;
+        v_uint32x4 lo, hi;
+        v_expand(v_load(src), lo, hi);
+        a = v_cvt_f32(v_reinterpret_as_s32(lo));
+        b = v_cvt_f32(v_reinterpret_as_s32(hi));
+    }
+
+    inline void load8(const float* src, cv::v_float32x4& a, cv::v_float32x4& b)
+    {
+        a = cv::v_load(src);
+        b = cv::v_load(src + 4);
+    }
+
+    // Same operations as lutIndex; the final integer clamp also catches NaN.
+    inline cv::v_int32x4 lutIndex4(const cv::v_float32x4& x, const MapParams& p)
+    {
+        using namespace cv;
+        const v_float32x4 one = v_setall_f32(1.f);
+        v_float32x4 v = v_max(x * v_setall_f32(p.scale) + v_setall_f32(p.offset), v_setzero_f32());
+        if (p.reinhard)
+            v = v / (one + v);
+        v_int32x4 i = v_round(v_min(v, one) * v_setall_f32(static_cast<float>(lutSize - 1)));
+        return v_min(v_max(i, v_setzero_s32()), v_setall_s32(lutSize - 1));
+    }
+#endif
+
+    template <typename T, int Channels>
+    void mapRow(const T* src, uchar* dst, int cols, const MapParams& p)
+    {
+        // Channels share one mapping, so the row is mapped as a flat array in
+        // chunks: vector code computes table indices, then a scalar pass looks
+        // them up.
+        const int n = cols * Channels;
+        const int chunk = 512;
+        int index[chunk];
+        for (int start = 0; start < n; start += chunk)
+        {
+            const int len = std::min(chunk, n - start);
+            const T* s = src + start;
+            int i = 0;
+#if CV_SIMD128
+            for (; i <= len - 8; i += 8)
+            {
+                cv::v_float32x4 a, b;
+                load8(s + i, a, b);
+                cv::v_store(index + i, lutIndex4(a, p));
+                cv::v_store(index + i + 4, lutIndex4(b, p));
+            }
+#endif
+            for (; i < len; i++)
+                index[i] = lutIndex(static_cast<float>(s[i]), p);
+            uchar* d = dst + start;
+            for (i = 0; i < len; i++)
+                d[i] = p.lut[index[i]];
+        }
+        if (Channels == 4)
+        {
+            for (int x = 0; x < cols; x++)
+                dst[x * 4 + 3] = cv::saturate_cast<uchar>(static_cast<float>(src[x * 4 + 3]) * (255.f / FormatWhite<T>::value));
+        }
+    }
+
+    template <typename T, int Channels>
+    void mapRows(const cv::Mat& src, cv::Mat& dst, const MapParams& p)
+    {
+        const double stripes = std::max(1.0, static_cast<double>(src.total()) / (1 << 16));
+        cv::parallel_for_(
+            cv::Range(0, src.rows),
+            [&](const cv::Range& range)
+            {
+                for (int y = range.start; y < range.end; y++)
+                    mapRow<T, Channels>(src.ptr<T>(y), dst.ptr<uchar>(y), src.cols, p);
+            },
+            stripes);
+    }
+
+    template <typename T>
+    void mapImage(const cv::Mat& src, cv::Mat& dst, const DisplayMapping& mapping, MapParams& p)
+    {
+        const float gain = static_cast<float>(std::pow(2.0, mapping.exposure)) / FormatWhite<T>::value;
+        if (mapping.curve == DisplayMapping::Reinhard)
+        {
+            p.scale = gain;
+            p.offset = static_cast<float>(-mapping.black);
+        }
+        else
+        {
+            const float range = static_cast<float>(std::max(mapping.white - mapping.black, 1e-6));
+            p.scale = gain / range;
+            p.offset = static_cast<float>(-mapping.black) / range;
+        }
+        switch (src.channels())
+        {
+        case 1:
+            mapRows<T, 1>(src, dst, p);
+            break;
+        case 3:
+            mapRows<T, 3>(src, dst, p);
+            break;
+        default:
+            mapRows<T, 4>(src, dst, p);
+            break;
+        }
+    }
+
+    // White of an integer depth; float data is already normalized.
+    double depthWhite(int depth)
+    {
+        switch (depth)
+        {
+        case CV_8U:
+            return 255.0;
+        case CV_8S:
+            return 127.0;
+        case CV_16U:
+            return 65535.0;
+        case CV_16S:
+            return 32767.0;
+        case CV_32S:
+            return 2147483647.0;
+        default:
+            return 1.0;
+        }
+    }
+
+    template <typename T>
+    void appendSamples(const cv::Mat& src, int step, std::vector<float>& samples)
+    {
+        const int cn = src.channels();
+        const int channels = std::min(cn, 3);
+        for (int y = 0; y < src.rows; y += step)
+        {
+            const T* row = src.ptr<T>(y);
+            for (int x = 0; x < src.cols; x += step)
+            {
+                for (int c = 0; c < channels; c++)
+                {
+                    float v = static_cast<float>(row[x * cn + c]);
+                    if (std::isfinite(v))
+                        samples.push_back(v);
+                }
+            }
+        }
+    }
+
+    // Samples of every channel but alpha, taken on a grid of about 64K pixels
+    // straight from src; converting the whole frame first would cost a
+    // float copy of it.
+    std::vector<float> sampleValues(const cv::Mat& src)
+    {
+        const int step = std::max(1, static_cast<int>(std::sqrt(static_cast<double>(src.total()) / 65536.0)));
+        std::vector<float> samples;
+        samples.reserve(static_cast<size_t>((src.rows / step + 1) * (src.cols / step + 1)) * std::min(src.channels(), 3));
+        switch (src.depth())
+        {
+        case CV_8U:
+            appendSamples<uchar>(src, step, samples);
+            break;
+        case CV_8S:
+            appendSamples<schar>(src, step, samples);
+            break;
+        case CV_16U:
+            appendSamples<ushort>(src, step, samples);
+            break;
+        case CV_16S:
+            appendSamples<short>(src, step, samples);
+            break;
+        case CV_32S:
+            appendSamples<int>(src, step, samples);
+            break;
+        case CV_32F:
+            appendSamples<float>(src, step, samples);
+            break;
+        case CV_64F:
+            appendSamples<double>(src, step, samples);
+            break;
+        case CV_16F:
+            appendSamples<cv::float16_t>(src, step, samples);
+            break;
+        default:
+            break;
+        }
+        return samples;
+    }
+} // namespace
+
+DisplayMapping autoDisplayMapping(const cv::Mat& src)
+{
+    DisplayMapping mapping;
+    if (src.empty() || src.depth() == CV_8U)
+        return mapping;
+    std::vector<float> samples = sampleValues(src);
+    if (samples.empty())
+        return mapping;
+    auto percentile = [&](double q)
+    {
+        auto it = samples.begin() + static_cast<ptrdiff_t>(q * (samples.size() - 1));
+        std::nth_element(samples.begin(), it, samples.end());
+        return static_cast<double>(*it);
+    };
+    double low = percentile(0.001);
+    double high = percentile(0.999);
+    if (src.depth() == CV_32F || src.depth() == CV_64F)
+    {
+        // Linear scene data: keep black at zero and expose for the highlights.
+        mapping.srgb = true;
+        mapping.black = 0.0;
+        mapping.white = high > 0.0 ? high : 1.0;
+        return mapping;
+    }
+    low /= depthWhite(src.depth());
+    high /= depthWhite(src.depth());
+    if (high > low)
+    {
+        mapping.black = std::max(0.0, low);
+        mapping.white = high;
+    }
+    return mapping;
+}
+
+cv::Mat toneMap(const cv::Mat& src, const DisplayMapping& mapping)
+{
+    if (src.empty() || src.channels() == 2 || src.channels() > 4)
+        return cv::Mat();
+    if (src.depth() == CV_8U && mapping.isIdentity())
+        return src;
+    TRACE_SCOPE("tone_map");
+
+    cv::Mat input = src;
+    if (src.depth() != CV_8U && src.depth() != CV_16U && src.depth() != CV_32F)
+    {
+        src.convertTo(input, CV_MAKETYPE(CV_32F, src.channels()), 1.0 / depthWhite(src.depth()));
+    }
+
+    MapParams p;
+    p.reinhard = mapping.curve == DisplayMapping::Reinhard;
+    for (int i = 0; i < lutSize; i++)
+    {
+        double v = static_cast<double>(i) / (lutSize - 1);
+        if (mapping.srgb)
+            v = v <= 0.0031308 ? 12.92 * v : 1.055 * std::pow(v, 1.0 / 2.4) - 0.055;
+        p.lut[i] = cv::saturate_cast<uchar>(v * 255.0);
+    }
+
+    cv::Mat dst(input.size(), CV_MAKETYPE(CV_8U, input.channels()));
+    switch (input.depth())
+    {
+    case CV_8U:
+        mapImage<uchar>(input, dst, mapping, p);
+        break;
+    case CV_16U:
+        mapImage<ushort>(input, dst, mapping, p);
+        break;
+    default:
+        mapImage<float>(input, dst, mapping, p);
+        break;
+    }
+    return dst;
+}
+
+cv::Mat toBgr8(const cv::Mat& src)
+{
+    if (src.empty() || src.type() == CV_8UC3)
+        return src;
+    return toBgr8(src, autoDisplayMapping(src));
+}
+
+cv::Mat toBgr8(const cv::Mat& src, const DisplayMapping& mapping)
+{
+    if (src.empty() || src.type() == CV_8UC3)
+        return src;
+    cv::Mat mapped = toneMap(src, mapping);
+    if (mapped.empty())
+        return mapped;
+    cv::Mat bgr;
+    if (mapped.channels() == 1)
+        cv::cvtColor(mapped, bgr, cv::COLOR_GRAY2BGR);
+    else if (mapped.channels() == 4)
+        cv::cvtColor(mapped, bgr, cv::COLOR_BGRA2BGR);
+    else
+        bgr = mapped;
+    return bgr;
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef TONE_MAP_H
+#define TONE_MAP_H
+
+#include <opencv2/opencv.hpp>
+
+// How a decoded image is mapped to 8-bit for display. Levels are in units of
+// the format's white: 255 for 8-bit, 65535 for 16-bit and 1.0 for float.
+struct DisplayMapping
+{
+    enum Curve
+    {
+        // Clips to [black, white].
+        Linear,
+        // Compresses [black, inf) smoothly into [0, 1); white is ignored.
+        Reinhard
+    };
+
+    // Stops, applied before the window.
+    double exposure = 0.0;
+    double black = 0.0;
+    double white = 1.0;
+    Curve curve = Linear;
+    // Encode the result with the sRGB curve; for linear data such as EXR.
+    bool srgb = false;
+
+    bool isIdentity() const { return exposure == 0.0 && black == 0.0 && white == 1.0 && curve == Linear && !srgb; }
+};
+
+// Window from the 0.1 and 99.9 percentiles of a subsample; sRGB for float.
+// 8-bit images get the identity.
+DisplayMapping autoDisplayMapping(const cv::Mat& src);
+
+// Maps 1-, 3- or 4-channel 8U, 16U or 32F data (other depths are converted
+// to float first) to 8-bit with the same channel count; alpha is scaled, not
+// mapped. Rows run on cv::parallel_for_ with universal intrinsics, so changing
+// the mapping re-maps a 50 MP frame without decoding it again. An 8-bit
+// image with the identity mapping is returned as is.
+cv::Mat toneMap(const cv::Mat& src, const DisplayMapping& mapping);
+
+// 8-bit BGR as plugins expect it, using autoDisplayMapping.
+cv::Mat toBgr8(const cv::Mat& src);
+// Same with a mapping the caller already computed; 8-bit BGR is returned as is.
+cv::Mat toBgr8(const cv::Mat& src, const DisplayMapping& mapping);
+
+#endif // TONE_MAP_H
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "trace.h"
+#include <QFile>
+#include <QMutex>
+#include <QTextStream>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    struct TraceEvent
+    {
+        const char* name;
+        qint64 startNs;
+        qint64 durationNs;
+        int tid;
+    };
+
+    // Bounds memory when tracing is left on for a long session.
+    const size_t maxEvents = 1000000;
+
+    QMutex traceMutex;
+    std::vector<TraceEvent> events;
+    QVector<QPair<const char*, qint64>> frame;
+    std::atomic<int> nextTid(1);
+
+    int currentTid()
+    {
+        thread_local int tid = nextTid++;
+        return tid;
+    }
+
+    QString jsonEscape(const char* text)
+    {
+        QString escaped;
+        for (const QChar c : QString::fromUtf8(text))
+        {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            if (c.unicode() < 0x20)
+                escaped += QString("\\u%1").arg(c.unicode(), 4, 16, QChar('0'));
+            else
+                escaped += c;
+        }
+        return escaped;
+    }
+} // namespace
+
+std::atomic<bool> Trace::enabled(false);
+
+void Trace::setEnabled(bool on)
+{
+    enabled.store(on, std::memory_order_relaxed);
+}
+
+qint64 Trace::nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Trace::record(const char* name, qint64 startNs, qint64 durationNs)
+{
+    int tid = currentTid();
+    QMutexLocker locker(&traceMutex);
+    if (events.size() < maxEvents)
+        events.push_back({name, startNs, durationNs, tid});
+    for (auto& entry : frame)
+    {
+        if (std::strcmp(entry.first, name) == 0)
+        {
+            entry.second = durationNs;
+            return;
+        }
+    }
+    frame.append(qMakePair(name, durationNs));
+}
+
+void Trace::beginFrame()
+{
+    QMutexLocker locker(&traceMutex);
+    frame.clear();
+}
+
+QVector<QPair<QString, double>> Trace::frameDurations()
+{
+    QMutexLocker locker(&traceMutex);
+    QVector<QPair<QString, double>> durations;
+    durations.reserve(frame.size());
+    for (const auto& entry : frame)
+        durations.append(qMakePair(QString::fromUtf8(entry.first), entry.second / 1e6));
+    return durations;
+}
+
+int Trace::eventCount()
+{
+    QMutexLocker locker(&traceMutex);
+    return static_cast<int>(events.size());
+}
+
+bool Trace::exportChromeTrace(const QString& path)
+{
+    std::vector<TraceEvent> snapshot;
+    {
+        QMutexLocker locker(&traceMutex);
+        snapshot = events;
+    }
+
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        return false;
+    QTextStream out(&file);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for (size_t i = 0; i < snapshot.size(); i++)
+    {
+        const TraceEvent& e = snapshot[i];
+        out << (i ? ",\n" : "\n") << "{\"name\":\"" << jsonEscape(e.name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.tid << ",\"ts\":" << QString::number(e.startNs / 1000.0, 'f', 3)
+            << ",\"dur\":" << QString::number(e.durationNs / 1000.0, 'f', 3) << "}";
+    }
+    out << "\n]}\n";
+    return out.status() == QTextStream::Ok;
+}
+
+void Trace::clear()
+{
+    QMutexLocker locker(&traceMutex);
+    events.clear();
+    frame.clear();
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2024 Ar-Ray-code
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QPair>
+#include <QString>
+#include <QVector>
+#include <atomic>
+
+// Process-wide span recorder. When disabled, a TRACE_SCOPE costs one relaxed
+// atomic load. Span names must outlive the trace (string literals or names
+// interned by the caller).
+class Trace
+{
+public:
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+    static void setEnabled(bool on);
+
+    static qint64 nowNs();
+    static void record(const char* name, qint64 startNs, qint64 durationNs);
+
+    // Clears the per-frame durations shown by the overlay.
+    static void beginFrame();
+    static QVector<QPair<QString, double>> frameDurations();
+
+    // Spans recorded so far, including while tracing was on earlier.
+    static int eventCount();
+    // Writes every recorded span in Chrome/Perfetto trace event format.
+    static bool exportChromeTrace(const QString& path);
+    static void clear();
+
+private:
+    static std::atomic<bool> enabled;
+};
+
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* name) : name(Trace::isEnabled() ? name : nullptr), start(this->name ? Trace::nowNs() : 0) {}
+    ~TraceScope()
+    {
+        if (name)
+            Trace::record(name, start, Trace::nowNs() - start);
+    }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name;
+    qint64 start;
+};
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+
+#endif // TRACE_H